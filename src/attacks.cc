@@ -240,11 +240,55 @@ class Magics {
   std::array<SquareMagic, kSquareLast> magics_;
 };
 
+/**
+ * Lookup tables for the line through two squares and for the squares strictly
+ * between them, indexed by both squares. Entries for pairs of squares that
+ * don't share a rank, file, or diagonal are empty.
+ */
+class LineTable {
+ public:
+  consteval LineTable() : lines_(), between_() {
+    for (int i = A1; i < kSquareLast; i++) {
+      Square sq = static_cast<Square>(i);
+      add_lines<kBishop>(sq);
+      add_lines<kRook>(sq);
+    }
+  }
+
+  constexpr Bitboard line(Square a, Square b) const { return lines_[a][b]; }
+
+  constexpr Bitboard between(Square a, Square b) const {
+    return between_[a][b];
+  }
+
+ private:
+  template <PieceKind Kind>
+  consteval void add_lines(Square a) {
+    Bitboard a_board;
+    a_board.set(a);
+    Bitboard rays = sliding_attack<Kind>(a, Bitboard());
+    Bitboard targets = rays;
+    while (!targets.empty()) {
+      Square b = targets.pop();
+      Bitboard b_board;
+      b_board.set(b);
+      lines_[a][b] =
+          (rays & sliding_attack<Kind>(b, Bitboard())) | a_board | b_board;
+      between_[a][b] =
+          sliding_attack<Kind>(a, b_board) & sliding_attack<Kind>(b, a_board);
+    }
+  }
+
+  std::array<std::array<Bitboard, kSquareLast>, kSquareLast> lines_;
+  std::array<std::array<Bitboard, kSquareLast>, kSquareLast> between_;
+};
+
 KingTable kKingTable = KingTable();
 PawnTable kPawnTable = PawnTable();
 KnightTable kKnightTable = KnightTable();
 Magics<kBishop> kBishopTable = Magics<kBishop>(kBishopMagicAttacks);
 Magics<kRook> kRookTable = Magics<kRook>(kRookMagicAttacks);
+LineTable kLineTable = LineTable();
 
 }  // namespace
 
@@ -257,5 +301,7 @@ Bitboard bishops(Square sq, Bitboard occupancy) {
 Bitboard rooks(Square sq, Bitboard occupancy) {
   return kRookTable.attacks(sq, occupancy);
 }
+Bitboard line(Square a, Square b) { return kLineTable.line(a, b); }
+Bitboard between(Square a, Square b) { return kLineTable.between(a, b); }
 
 }  // namespace altair::attacks
@@ -76,6 +76,18 @@ Bitboard knights(Square sq);
 Bitboard bishops(Square sq, Bitboard occupancy);
 Bitboard rooks(Square sq, Bitboard occupancy);
 
+/**
+ * The squares on the rank, file, or diagonal running through both squares,
+ * including the squares themselves. Empty if they don't share one.
+ */
+Bitboard line(Square a, Square b);
+
+/**
+ * The squares strictly between two squares on a shared rank, file, or
+ * diagonal. Empty if they don't share one.
+ */
+Bitboard between(Square a, Square b);
+
 inline Bitboard queens(Square sq, Bitboard occupancy) {
   return bishops(sq, occupancy) | rooks(sq, occupancy);
 }
@@ -18,6 +18,8 @@
 
 #pragma once
 
+#include <cstddef>
+
 #ifdef _MSC_VER
 #include <intrin.h>
 #endif /* _MSC_VER */
@@ -47,6 +49,35 @@
 #error "count_trailing_zeroes not implemented for this compiler"
 #endif
 
+/**
+ * Computes the high 64 bits of the 128-bit product of two 64-bit unsigned
+ * integers.
+ * uint64_t multiply_high64(uint64_t a, uint64_t b)
+ */
+#if defined(_MSC_VER)
+#define multiply_high64(a, b) __umulh((a), (b))
+#elif defined(__GNUC__) || defined(__clang__)
+#define multiply_high64(a, b) \
+  static_cast<uint64_t>((static_cast<unsigned __int128>(a) * (b)) >> 64)
+#else
+#error "multiply_high64 not implemented for this compiler"
+#endif
+
+/**
+ * Hint to the processor that the cache line containing the given address will
+ * be read soon.
+ * void prefetch_cache_line(const void* addr)
+ */
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define prefetch_cache_line(addr) \
+  _mm_prefetch(reinterpret_cast<const char*>((addr)), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define prefetch_cache_line(addr) __builtin_prefetch((addr))
+#else
+#error "prefetch_cache_line not implemented for this compiler"
+#endif
+
 /**
  * Hint to the compiler that this line of code is unreachable.
  * [[noreturn]] void unreachable()
@@ -65,3 +96,15 @@
 #define MSVC_WARNING_DISABLE(number)
 #endif /* _MSC_VER */
 
+namespace altair {
+
+/**
+ * Data written by different threads should be at least this far apart, so
+ * that the threads don't contend for the same cache line. This is fixed rather
+ * than taken from std::hardware_destructive_interference_size, which varies
+ * with the tuning flags and would change the layout of aligned types with
+ * them.
+ */
+constexpr size_t kCacheLineSize = 64;
+
+}  // namespace altair
@@ -152,4 +152,6 @@ Value evaluate(const Position& pos) {
   return white_total - black_total;
 }
 
+Value piece_value(PieceKind kind) { return kPieceValues[kind]; }
+
 }  // namespace altair::eval
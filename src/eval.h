@@ -25,4 +25,9 @@ namespace altair::eval {
 
 Value evaluate(const Position& pos);
 
+/**
+ * The material value of a piece of the given kind.
+ */
+Value piece_value(PieceKind kind);
+
 }
\ No newline at end of file
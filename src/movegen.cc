@@ -24,8 +24,62 @@ namespace altair::movegen {
 
 namespace {
 
-template <Color Us>
-void generate_pawn_moves(const Position& pos, std::vector<Move>& moves) {
+/**
+ * The subsets of moves that a generator can be asked to produce.
+ */
+enum class GenType {
+  /**
+   * All pseudolegal moves.
+   */
+  kAll,
+
+  /**
+   * Captures and promotions only; the moves that change material on the board.
+   */
+  kCaptures,
+
+  /**
+   * Everything else: quiet moves, double pawn pushes and castles.
+   */
+  kQuiets,
+};
+
+/**
+ * Restrictions on the moves that pieces of the side to move can make, computed
+ * once per position for legal move generation. The default value places no
+ * restrictions and generates pseudolegal moves.
+ */
+struct Constraints {
+  /**
+   * Whether to test king moves and en passant captures for legality, since
+   * the masks below don't account for them.
+   */
+  bool legal = false;
+
+  /**
+   * Squares that pieces other than the king may move to. When in check, this
+   * is the checking piece and the squares between it and the king.
+   */
+  Bitboard targets = ~Bitboard();
+
+  /**
+   * Pieces pinned to their own king, which can only move along the pin.
+   */
+  Bitboard pinned;
+  Square king = kNoSquare;
+
+  /**
+   * Returns whether a pinned piece stays on its pin line by moving from one
+   * square to another. Always true for pieces that aren't pinned.
+   */
+  bool keeps_pin(Square from, Square to) const {
+    return !pinned.test(from) || attacks::line(king, from).test(to);
+  }
+};
+
+template <GenType Type, Color Us>
+void generate_pawn_moves(const Position& pos, const Constraints& constraints,
+                         MoveList& moves) {
   constexpr Color Them = !Us;
   constexpr Bitboard StartRank = Us == kWhite ? kBBRank2 : kBBRank7;
   constexpr Bitboard PromoRank = Us == kWhite ? kBBRank8 : kBBRank1;
@@ -39,6 +93,7 @@ void generate_pawn_moves(const Position& pos, std::vector<Move>& moves) {
   Bitboard pieces = allied_pieces | enemy_pieces;
   Bitboard empty_squares = ~pieces;
   Bitboard pawns = pos.pieces(Us, kPawn);
+  Bitboard targets = constraints.targets;
 
   // Pawns on the seventh rank move with promotion and are handled separately
   // from all other pawns on the board.
@@ -48,75 +103,112 @@ void generate_pawn_moves(const Position& pos, std::vector<Move>& moves) {
   // 1) Non-capture non-promo moves.
   // Pawns move one square up from anywhere on the board, if unimpeded.
   // Pawns on the start rank can move twice, also if unimpeded.
-  Bitboard advance = shift<Up>(pawns_not_on_seventh) & empty_squares;
-  Bitboard double_advance = shift<Up>(advance & ThirdRank) & empty_squares;
-  while (!advance.empty()) {
-    Square dest = advance.pop();
-    moves.push_back(Move::quiet(towards(dest, Down), dest));
+  if constexpr (Type != GenType::kCaptures) {
+    Bitboard advance = shift<Up>(pawns_not_on_seventh) & empty_squares;
+    Bitboard double_advance =
+        shift<Up>(advance & ThirdRank) & empty_squares & targets;
+    advance = advance & targets;
+    while (!advance.empty()) {
+      Square dest = advance.pop();
+      Square source = towards(dest, Down);
+      if (constraints.keeps_pin(source, dest)) {
+        moves.push_back(Move::quiet(source, dest));
+      }
+    }
+    while (!double_advance.empty()) {
+      Square dest = double_advance.pop();
+      Square source = towards(dest, Down + Down);
+      if (constraints.keeps_pin(source, dest)) {
+        moves.push_back(Move::double_pawn_push(source, dest));
+      }
+    }
   }
-  while (!double_advance.empty()) {
-    Square dest = double_advance.pop();
-    moves.push_back(Move::double_pawn_push(towards(dest, Down + Down), dest));
+
+  if constexpr (Type == GenType::kQuiets) {
+    return;
   }
 
   // 2) Capture non-promo moves.
-  Bitboard captures_left =
-      shift<Up + kDirectionWest>(pawns_not_on_seventh) & enemy_pieces;
-  Bitboard captures_right =
-      shift<Up + kDirectionEast>(pawns_not_on_seventh) & enemy_pieces;
+  Bitboard captures_left = shift<Up + kDirectionWest>(pawns_not_on_seventh) &
+                           enemy_pieces & targets;
+  Bitboard captures_right = shift<Up + kDirectionEast>(pawns_not_on_seventh) &
+                            enemy_pieces & targets;
   while (!captures_left.empty()) {
     Square dest = captures_left.pop();
-    moves.push_back(Move::capture(towards(dest, Down + kDirectionEast), dest));
+    Square source = towards(dest, Down + kDirectionEast);
+    if (constraints.keeps_pin(source, dest)) {
+      moves.push_back(Move::capture(source, dest));
+    }
   }
   while (!captures_right.empty()) {
     Square dest = captures_right.pop();
-    moves.push_back(Move::capture(towards(dest, Down + kDirectionWest), dest));
+    Square source = towards(dest, Down + kDirectionWest);
+    if (constraints.keeps_pin(source, dest)) {
+      moves.push_back(Move::capture(source, dest));
+    }
   }
 
   // 3) Promotion moves.
   if (!pawns_on_seventh.empty()) {
-    Bitboard promo_advance = shift<Up>(pawns_on_seventh) & empty_squares;
-    Bitboard promo_capture_left =
-        shift<Up + kDirectionWest>(pawns_on_seventh) & enemy_pieces;
+    Bitboard promo_advance =
+        shift<Up>(pawns_on_seventh) & empty_squares & targets;
+    Bitboard promo_capture_left = shift<Up + kDirectionWest>(pawns_on_seventh) &
+                                  enemy_pieces & targets;
     Bitboard promo_capture_right =
-        shift<Up + kDirectionEast>(pawns_on_seventh) & enemy_pieces;
+        shift<Up + kDirectionEast>(pawns_on_seventh) & enemy_pieces & targets;
 
     while (!promo_advance.empty()) {
       Square dest = promo_advance.pop();
+      Square source = towards(dest, Down);
+      if (!constraints.keeps_pin(source, dest)) {
+        continue;
+      }
       for (PieceKind kind : {kKnight, kBishop, kRook, kQueen}) {
-        moves.push_back(Move::promotion(towards(dest, Down), dest, kind));
+        moves.push_back(Move::promotion(source, dest, kind));
       }
     }
 
     while (!promo_capture_left.empty()) {
       Square dest = promo_capture_left.pop();
+      Square source = towards(dest, Down + kDirectionEast);
+      if (!constraints.keeps_pin(source, dest)) {
+        continue;
+      }
       for (PieceKind kind : {kKnight, kBishop, kRook, kQueen}) {
-        moves.push_back(Move::promotion_capture(
-            towards(dest, Down + kDirectionEast), dest, kind));
+        moves.push_back(Move::promotion_capture(source, dest, kind));
       }
     }
 
     while (!promo_capture_right.empty()) {
       Square dest = promo_capture_right.pop();
+      Square source = towards(dest, Down + kDirectionWest);
+      if (!constraints.keeps_pin(source, dest)) {
+        continue;
+      }
       for (PieceKind kind : {kKnight, kBishop, kRook, kQueen}) {
-        moves.push_back(Move::promotion_capture(
-            towards(dest, Down + kDirectionWest), dest, kind));
+        moves.push_back(Move::promotion_capture(source, dest, kind));
       }
     }
   }
 
-  // 4) En-passant.
+  // 4) En-passant. This is the one capture where the captured piece isn't on
+  // the destination square, and it removes two pieces from the same rank, so
+  // its legality is tested directly rather than with the masks.
   if (pos.en_passant_square() != kNoSquare) {
     Bitboard attackers = attacks::pawns(pos.en_passant_square(), !Us) & pawns;
     while (!attackers.empty()) {
       Square attacker = attackers.pop();
-      moves.push_back(Move::en_passant(attacker, pos.en_passant_square()));
+      Move move = Move::en_passant(attacker, pos.en_passant_square());
+      if (!constraints.legal || pos.is_legal(move)) {
+        moves.push_back(move);
+      }
     }
   }
 }
 
-template <PieceKind Kind, Color Us>
-void generate_moves(const Position& pos, std::vector<Move>& moves) {
+template <GenType Type, PieceKind Kind, Color Us>
+void generate_moves(const Position& pos, const Constraints& constraints,
+                    MoveList& moves) {
   constexpr Color Them = !Us;
   Bitboard moving_pieces = pos.pieces(Us, Kind);
   Bitboard allied_pieces = pos.pieces(Us);
@@ -126,16 +218,34 @@ void generate_moves(const Position& pos, std::vector<Move>& moves) {
   while (!moving_pieces.empty()) {
     Square piece = moving_pieces.pop();
     Bitboard destinations = attacks::pieces<Kind>(piece, pieces);
+    if constexpr (Kind != kKing) {
+      destinations = destinations & constraints.targets;
+      if (constraints.pinned.test(piece)) {
+        destinations = destinations & attacks::line(constraints.king, piece);
+      }
+    }
+
     while (!destinations.empty()) {
       Square target = destinations.pop();
+      Move move;
       if (enemy_pieces.test(target)) {
-        moves.push_back(Move::capture(piece, target));
-      } else if (!allied_pieces.test(target)) {
-        moves.push_back(Move::quiet(piece, target));
+        if (Type == GenType::kQuiets) {
+          continue;
+        }
+        move = Move::capture(piece, target);
+      } else if (Type != GenType::kCaptures && !allied_pieces.test(target)) {
+        move = Move::quiet(piece, target);
+      } else {
+        continue;
       }
+
+      if (Kind == kKing && constraints.legal && !pos.is_legal(move)) {
+        continue;
+      }
+      moves.push_back(move);
     }
 
-    if constexpr (Kind == kKing) {
+    if constexpr (Kind == kKing && Type != GenType::kCaptures) {
       constexpr Piece rook = Us == kWhite ? kWhiteRook : kBlackRook;
 
       // Here we consider kingside and queenside castles, if the side to move
@@ -183,24 +293,86 @@ void generate_moves(const Position& pos, std::vector<Move>& moves) {
   }
 }
 
-}  // namespace
+template <GenType Type, Color Us>
+void generate(const Position& pos, const Constraints& constraints,
+              MoveList& moves) {
+  // In double check, only the king can move.
+  if (!constraints.targets.empty()) {
+    generate_pawn_moves<Type, Us>(pos, constraints, moves);
+    generate_moves<Type, kKnight, Us>(pos, constraints, moves);
+    generate_moves<Type, kBishop, Us>(pos, constraints, moves);
+    generate_moves<Type, kRook, Us>(pos, constraints, moves);
+    generate_moves<Type, kQueen, Us>(pos, constraints, moves);
+  }
+  generate_moves<Type, kKing, Us>(pos, constraints, moves);
+}
 
-void generate_pseudolegal(const Position& pos, std::vector<Move>& moves) {
+template <GenType Type>
+void generate(const Position& pos, const Constraints& constraints,
+              MoveList& moves) {
   if (pos.side_to_move() == kWhite) {
-    generate_pawn_moves<kWhite>(pos, moves);
-    generate_moves<kKnight, kWhite>(pos, moves);
-    generate_moves<kBishop, kWhite>(pos, moves);
-    generate_moves<kRook, kWhite>(pos, moves);
-    generate_moves<kQueen, kWhite>(pos, moves);
-    generate_moves<kKing, kWhite>(pos, moves);
+    generate<Type, kWhite>(pos, constraints, moves);
   } else {
-    generate_pawn_moves<kBlack>(pos, moves);
-    generate_moves<kKnight, kBlack>(pos, moves);
-    generate_moves<kBishop, kBlack>(pos, moves);
-    generate_moves<kRook, kBlack>(pos, moves);
-    generate_moves<kQueen, kBlack>(pos, moves);
-    generate_moves<kKing, kBlack>(pos, moves);
+    generate<Type, kBlack>(pos, constraints, moves);
+  }
+}
+
+/**
+ * Computes the constraints on the side to move: the squares that resolve a
+ * check, if in check, and the pieces pinned to the king.
+ */
+Constraints legal_constraints(const Position& pos) {
+  Color us = pos.side_to_move();
+  Color them = !us;
+  Constraints constraints;
+  constraints.legal = true;
+  constraints.king = pos.pieces(us, kKing).expect_one();
+
+  Bitboard checkers = pos.squares_attacking(constraints.king, them);
+  if (checkers.size() > 1) {
+    constraints.targets = Bitboard();
+  } else if (!checkers.empty()) {
+    Square checker = Bitboard(checkers).expect_one();
+    constraints.targets =
+        checkers | attacks::between(constraints.king, checker);
+  }
+
+  // A piece is pinned if it's the only piece between the king and an enemy
+  // slider that would otherwise attack it.
+  Bitboard occupancy = pos.pieces(us) | pos.pieces(them);
+  Bitboard queens = pos.pieces(them, kQueen);
+  Bitboard snipers =
+      (attacks::bishops(constraints.king, Bitboard()) &
+       (pos.pieces(them, kBishop) | queens)) |
+      (attacks::rooks(constraints.king, Bitboard()) &
+       (pos.pieces(them, kRook) | queens));
+  while (!snipers.empty()) {
+    Square sniper = snipers.pop();
+    Bitboard blockers = attacks::between(constraints.king, sniper) & occupancy;
+    if (blockers.size() == 1 && !(blockers & pos.pieces(us)).empty()) {
+      constraints.pinned |= blockers;
+    }
   }
+
+  return constraints;
+}
+
+}  // namespace
+
+void generate_pseudolegal(const Position& pos, MoveList& moves) {
+  generate<GenType::kAll>(pos, Constraints(), moves);
+}
+
+void generate_captures(const Position& pos, MoveList& moves) {
+  generate<GenType::kCaptures>(pos, Constraints(), moves);
+}
+
+void generate_quiets(const Position& pos, MoveList& moves) {
+  generate<GenType::kQuiets>(pos, Constraints(), moves);
+}
+
+void generate_legal(const Position& pos, MoveList& moves) {
+  generate<GenType::kAll>(pos, legal_constraints(pos), moves);
 }
 
 }  // namespace altair::movegen
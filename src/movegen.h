@@ -18,8 +18,7 @@
 
 #pragma once
 
-#include <vector>
-
+#include "movelist.h"
 #include "position.h"
 
 namespace altair::movegen {
@@ -31,6 +30,25 @@ namespace altair::movegen {
  * chess. Rules that are enforced later are moves that place the king in check
  * in non-obvious ways, such as absolute pins.
  */
-void generate_pseudolegal(const Position& pos, std::vector<Move>& moves);
+void generate_pseudolegal(const Position& pos, MoveList& moves);
+
+/**
+ * Generates the subset of pseudolegal moves that are captures or promotions,
+ * for use in quiescence search.
+ */
+void generate_captures(const Position& pos, MoveList& moves);
+
+/**
+ * Generates the pseudolegal moves that generate_captures doesn't; between
+ * them, the two produce every pseudolegal move.
+ */
+void generate_quiets(const Position& pos, MoveList& moves);
+
+/**
+ * Generates legal moves for the given position. Checks and pins are worked out
+ * once for the position, so that, unlike pseudolegal moves, no move needs to
+ * be made to test whether it leaves the king in check.
+ */
+void generate_legal(const Position& pos, MoveList& moves);
 
 }  // namespace altair::movegen
\ No newline at end of file
@@ -18,6 +18,9 @@
 
 #include "movegen.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <initializer_list>
 #include <vector>
 
@@ -25,6 +28,7 @@
 #include "move.h"
 
 using altair::Move;
+using altair::MoveList;
 using altair::PieceKind;
 using altair::Position;
 
@@ -32,7 +36,7 @@ namespace {
 
 void assert_moves(const Position& pos,
                   std::initializer_list<Move> expected_moves) {
-  std::vector<Move> moves;
+  MoveList moves;
   altair::movegen::generate_pseudolegal(pos, moves);
   for (Move expected : expected_moves) {
     bool seen_move = false;
@@ -52,7 +56,7 @@ void assert_moves(const Position& pos,
 
 void assert_not_moves(const Position& pos,
                       std::initializer_list<Move> unexpected_moves) {
-  std::vector<Move> moves;
+  MoveList moves;
   altair::movegen::generate_pseudolegal(pos, moves);
   for (Move unexpected : unexpected_moves) {
     for (Move move : moves) {
@@ -64,6 +68,41 @@ void assert_not_moves(const Position& pos,
   }
 }
 
+/**
+ * Checks that generate_legal agrees with filtering pseudolegal moves by making
+ * them, at every node of the tree of the given depth.
+ */
+void check_legal_tree(Position& pos, unsigned depth) {
+  MoveList pseudolegal;
+  altair::movegen::generate_pseudolegal(pos, pseudolegal);
+  MoveList expected;
+  for (Move move : pseudolegal) {
+    pos.make_move(move);
+    if (!pos.is_check(!pos.side_to_move())) {
+      expected.push_back(move);
+    }
+    pos.unmake_move(move);
+  }
+
+  MoveList legal;
+  altair::movegen::generate_legal(pos, legal);
+  ASSERT_EQ(expected.size(), legal.size()) << pos.fen();
+  for (Move move : expected) {
+    ASSERT_NE(std::find(legal.begin(), legal.end(), move), legal.end())
+        << "missing legal move '" << move.as_uci() << "' in " << pos.fen();
+  }
+
+  if (depth == 0) {
+    return;
+  }
+
+  for (Move move : legal) {
+    pos.make_move(move);
+    check_legal_tree(pos, depth - 1);
+    pos.unmake_move(move);
+  }
+}
+
 }  // namespace
 
 TEST(Movegen, pawn_advance_smoke) {
@@ -164,4 +203,69 @@ TEST(Movegen, king_smoke) {
   assert_not_moves(pos, {
                             Move::quiet(altair::C3, altair::B2),
                         });
-}
\ No newline at end of file
+}
+
+TEST(Movegen, captures_only) {
+  Position pos;
+  pos.set("r3k3/1P6/8/3p4/4P3/8/8/R3K2R w KQq - 0 1");
+  MoveList moves;
+  altair::movegen::generate_captures(pos, moves);
+  for (Move move : moves) {
+    EXPECT_TRUE(move.is_capture() || move.is_promotion())
+        << "unexpected quiet move '" << move.as_uci() << "'";
+  }
+
+  auto contains = [&](Move expected) {
+    return std::find(moves.begin(), moves.end(), expected) != moves.end();
+  };
+  EXPECT_TRUE(contains(Move::capture(altair::E4, altair::D5)));
+  EXPECT_TRUE(contains(Move::capture(altair::A1, altair::A8)));
+  EXPECT_TRUE(
+      contains(Move::promotion(altair::B7, altair::B8, altair::kQueen)));
+  EXPECT_TRUE(contains(
+      Move::promotion_capture(altair::B7, altair::A8, altair::kKnight)));
+  EXPECT_FALSE(contains(Move::kingside_castle(altair::E1, altair::G1)));
+}
+
+TEST(Movegen, legal_matches_filtered_pseudolegal) {
+  for (const char* fen : {
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+       }) {
+    Position pos;
+    pos.set(fen);
+    check_legal_tree(pos, 2);
+  }
+}
+
+TEST(Movegen, captures_and_quiets_partition_pseudolegal) {
+  for (const char* fen : {
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+       }) {
+    Position pos;
+    pos.set(fen);
+    MoveList all;
+    altair::movegen::generate_pseudolegal(pos, all);
+    MoveList split;
+    altair::movegen::generate_captures(pos, split);
+    size_t captures = split.size();
+    altair::movegen::generate_quiets(pos, split);
+    for (size_t i = captures; i < split.size(); i++) {
+      EXPECT_FALSE(split[i].is_capture() || split[i].is_promotion())
+          << "unexpected capture '" << split[i].as_uci() << "'";
+    }
+
+    std::vector<Move> expected(all.begin(), all.end());
+    std::vector<Move> actual(split.begin(), split.end());
+    auto by_bits = [](Move a, Move b) {
+      return std::bit_cast<uint16_t>(a) < std::bit_cast<uint16_t>(b);
+    };
+    std::sort(expected.begin(), expected.end(), by_bits);
+    std::sort(actual.begin(), actual.end(), by_bits);
+    EXPECT_EQ(expected, actual) << fen;
+  }
+}
@@ -0,0 +1,90 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "log.h"
+#include "move.h"
+
+namespace altair {
+
+/**
+ * A move along with a score, used by the search to order moves.
+ */
+struct ScoredMove {
+  Move move;
+  int32_t score;
+
+  operator Move() const { return move; }
+  bool operator==(const Move other) const { return move == other; }
+};
+
+/**
+ * A fixed-capacity list of moves. Move lists live on the stack, so generating
+ * moves at a node never allocates. The storage is left uninitialized, since
+ * a list is created at every node and typically only a fraction of it is used.
+ */
+class MoveList {
+ public:
+  /**
+   * The most legal moves known in any position is 218; pseudolegal moves don't
+   * add many more.
+   */
+  static constexpr size_t kCapacity = 256;
+
+  MoveList() : size_(0) {}
+  MoveList(const MoveList& other) : size_(other.size_) {
+    std::copy(other.begin(), other.end(), moves_);
+  }
+  MoveList& operator=(const MoveList& other) {
+    size_ = other.size_;
+    std::copy(other.begin(), other.end(), moves_);
+    return *this;
+  }
+  ~MoveList() {}
+
+  void push_back(Move move) {
+    CHECK(size_ < kCapacity) << "move list overflow";
+    moves_[size_++] = ScoredMove{move, 0};
+  }
+
+  void clear() { size_ = 0; }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  Move operator[](size_t i) const { return moves_[i].move; }
+  Move front() const { return moves_[0].move; }
+
+  ScoredMove* begin() { return moves_; }
+  ScoredMove* end() { return moves_ + size_; }
+  const ScoredMove* begin() const { return moves_; }
+  const ScoredMove* end() const { return moves_ + size_; }
+
+ private:
+  union {
+    ScoredMove moves_[kCapacity];
+  };
+  size_t size_;
+};
+
+}  // namespace altair
@@ -0,0 +1,315 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "movepick.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "attacks.h"
+#include "log.h"
+#include "movegen.h"
+
+namespace altair {
+
+namespace {
+
+/**
+ * Piece values for exchanges. The king is worth more than everything else put
+ * together, so that it is never traded.
+ */
+constexpr std::array<int, kPieceKindLast> kSeeValues = {100, 320, 330,
+                                                        500, 900, 20000};
+
+/**
+ * Returns the pieces of either color that attack the given square, given the
+ * occupancy of the board.
+ */
+Bitboard attackers_to(const Position& pos, Square square, Bitboard occupancy) {
+  Bitboard queens = pos.pieces(kWhite, kQueen) | pos.pieces(kBlack, kQueen);
+  Bitboard diagonal =
+      pos.pieces(kWhite, kBishop) | pos.pieces(kBlack, kBishop) | queens;
+  Bitboard straight =
+      pos.pieces(kWhite, kRook) | pos.pieces(kBlack, kRook) | queens;
+  Bitboard knights = pos.pieces(kWhite, kKnight) | pos.pieces(kBlack, kKnight);
+  Bitboard kings = pos.pieces(kWhite, kKing) | pos.pieces(kBlack, kKing);
+  Bitboard attackers =
+      (attacks::pawns(square, kBlack) & pos.pieces(kWhite, kPawn)) |
+      (attacks::pawns(square, kWhite) & pos.pieces(kBlack, kPawn)) |
+      (attacks::knights(square) & knights) |
+      (attacks::bishops(square, occupancy) & diagonal) |
+      (attacks::rooks(square, occupancy) & straight) |
+      (attacks::kings(square) & kings);
+  return attackers & occupancy;
+}
+
+/**
+ * The piece that a move captures, or kNoPiece.
+ */
+Piece captured_piece(const Position& pos, Move move) {
+  if (move.is_en_passant()) {
+    return make_piece(kPawn, !pos.side_to_move());
+  }
+  return move.is_capture() ? pos.piece_at(move.destination()) : kNoPiece;
+}
+
+}  // namespace
+
+int see(const Position& pos, Move move) {
+  Square from = move.source();
+  Square to = move.destination();
+  Piece victim = captured_piece(pos, move);
+  PieceKind attacker = kind_of(pos.piece_at(from));
+
+  // gain[d] is the material balance, from the point of view of the side that
+  // makes the d'th capture, if the exchange stops after that capture.
+  std::array<int, 32> gain{};
+  gain[0] = victim != kNoPiece ? kSeeValues[kind_of(victim)] : 0;
+  if (move.is_promotion()) {
+    attacker = move.promotion_piece();
+    gain[0] += kSeeValues[attacker] - kSeeValues[kPawn];
+  }
+
+  Bitboard occupancy = pos.pieces(kWhite) | pos.pieces(kBlack);
+  occupancy.unset(from);
+  if (move.is_en_passant()) {
+    Direction down =
+        pos.side_to_move() == kWhite ? kDirectionSouth : kDirectionNorth;
+    occupancy.unset(towards(to, down));
+  }
+
+  Color side = !pos.side_to_move();
+  Bitboard attackers = attackers_to(pos, to, occupancy);
+  size_t depth = 0;
+  while (depth + 1 < gain.size()) {
+    // Find the side's least valuable attacker. Taking it off the board may
+    // reveal a slider behind it, which attackers_to picks up.
+    Bitboard ours = attackers & pos.pieces(side);
+    if (ours.empty()) {
+      break;
+    }
+
+    PieceKind next = kPawn;
+    Square next_square = kNoSquare;
+    for (PieceKind kind : {kPawn, kKnight, kBishop, kRook, kQueen, kKing}) {
+      Bitboard candidates = ours & pos.pieces(side, kind);
+      if (!candidates.empty()) {
+        next = kind;
+        next_square = candidates.pop();
+        break;
+      }
+    }
+
+    depth++;
+    gain[depth] = kSeeValues[attacker] - gain[depth - 1];
+    if (std::max(-gain[depth - 1], gain[depth]) < 0) {
+      // Neither side can gain by continuing.
+      break;
+    }
+
+    occupancy.unset(next_square);
+    attackers = attackers_to(pos, to, occupancy);
+    attacker = next;
+    side = !side;
+  }
+
+  while (depth > 0) {
+    gain[depth - 1] = -std::max(-gain[depth - 1], gain[depth]);
+    depth--;
+  }
+  return gain[0];
+}
+
+MovePicker::MovePicker(
+    const Position& pos, Move tt_move, const std::array<Move, 2>& killers,
+    Move countermove, const ButterflyHistory* history,
+    const std::array<const PieceToHistory*, 2>& continuations)
+    : pos_(pos),
+      stage_(Stage::kTTMove),
+      captures_only_(false),
+      skip_quiets_(false),
+      tt_move_(tt_move),
+      killers_(killers),
+      killer_index_(0),
+      countermove_(countermove),
+      history_(history),
+      continuations_(continuations),
+      current_(0) {
+  CHECK(tt_move.is_null() || pos.is_pseudolegal(tt_move))
+      << "TT move isn't pseudolegal";
+  if (tt_move_.is_null()) {
+    stage_ = Stage::kGenerateCaptures;
+  }
+}
+
+MovePicker::MovePicker(const Position& pos)
+    : pos_(pos),
+      stage_(Stage::kGenerateCaptures),
+      captures_only_(!pos.is_check(pos.side_to_move())),
+      skip_quiets_(false),
+      tt_move_(Move::null()),
+      killers_{Move::null(), Move::null()},
+      killer_index_(0),
+      countermove_(Move::null()),
+      history_(nullptr),
+      continuations_{nullptr, nullptr},
+      current_(0) {}
+
+Move MovePicker::next_move() {
+  while (true) {
+    switch (stage_) {
+      case Stage::kTTMove:
+        stage_ = Stage::kGenerateCaptures;
+        return tt_move_;
+
+      case Stage::kGenerateCaptures:
+        movegen::generate_captures(pos_, moves_);
+        score_captures();
+        stage_ = Stage::kGoodCaptures;
+        break;
+
+      case Stage::kGoodCaptures:
+        while (current_ < moves_.size()) {
+          Move move = pick_best();
+          if (move == tt_move_) {
+            continue;
+          }
+
+          // Promotions that don't capture are left alone: SEE would count
+          // the promoted piece as lost if the square is defended, but they
+          // are still usually the best moves in the position.
+          if (move.is_capture() && see(pos_, move) < 0) {
+            bad_captures_.push_back(move);
+            continue;
+          }
+          return move;
+        }
+
+        stage_ = captures_only_ ? Stage::kDone : Stage::kKillers;
+        break;
+
+      case Stage::kKillers:
+        while (!skip_quiets_ && killer_index_ < killers_.size()) {
+          Move move = killers_[killer_index_++];
+          if (move != tt_move_ && is_quiet_candidate(move)) {
+            return move;
+          }
+        }
+
+        stage_ = Stage::kCounterMove;
+        break;
+
+      case Stage::kCounterMove:
+        stage_ = Stage::kGenerateQuiets;
+        if (!skip_quiets_ && countermove_ != tt_move_ &&
+            countermove_ != killers_[0] && countermove_ != killers_[1] &&
+            is_quiet_candidate(countermove_)) {
+          return countermove_;
+        }
+        break;
+
+      case Stage::kGenerateQuiets:
+        moves_.clear();
+        current_ = 0;
+        if (!skip_quiets_) {
+          movegen::generate_quiets(pos_, moves_);
+          score_quiets();
+        }
+        stage_ = Stage::kQuiets;
+        break;
+
+      case Stage::kQuiets:
+        while (!skip_quiets_ && current_ < moves_.size()) {
+          Move move = pick_best();
+          if (!already_tried(move)) {
+            return move;
+          }
+        }
+
+        moves_ = bad_captures_;
+        current_ = 0;
+        stage_ = Stage::kBadCaptures;
+        break;
+
+      case Stage::kBadCaptures:
+        // Already in MVV-LVA order, since they were set aside as picked.
+        if (current_ < moves_.size()) {
+          return moves_[current_++];
+        }
+
+        stage_ = Stage::kDone;
+        break;
+
+      case Stage::kDone:
+        return Move::null();
+    }
+  }
+}
+
+void MovePicker::score_captures() {
+  // MVV-LVA: the most valuable victim first and, between captures of equal
+  // victims, the least valuable attacker first. Promotions score as captures
+  // of the promoted piece.
+  for (ScoredMove& scored : moves_) {
+    Move move = scored.move;
+    Piece victim = captured_piece(pos_, move);
+    int score = victim != kNoPiece ? kSeeValues[kind_of(victim)] * 8 : 0;
+    if (move.is_promotion()) {
+      score += kSeeValues[move.promotion_piece()] * 8;
+    }
+    scored.score = score - kind_of(pos_.piece_at(move.source()));
+  }
+}
+
+void MovePicker::score_quiets() {
+  Color us = pos_.side_to_move();
+  for (ScoredMove& scored : moves_) {
+    Square from = scored.move.source();
+    Square to = scored.move.destination();
+    int score = history_ != nullptr ? (*history_)[us][from][to] : 0;
+    Piece piece = pos_.piece_at(from);
+    for (const PieceToHistory* continuation : continuations_) {
+      if (continuation != nullptr) {
+        score += (*continuation)[piece][to];
+      }
+    }
+    scored.score = score;
+  }
+}
+
+Move MovePicker::pick_best() {
+  ScoredMove* best = std::max_element(
+      moves_.begin() + current_, moves_.end(),
+      [](const ScoredMove& a, const ScoredMove& b) {
+        return a.score < b.score;
+      });
+  std::swap(*best, *(moves_.begin() + current_));
+  return moves_[current_++];
+}
+
+bool MovePicker::already_tried(Move move) const {
+  return move == tt_move_ || move == killers_[0] || move == killers_[1] ||
+         move == countermove_;
+}
+
+bool MovePicker::is_quiet_candidate(Move move) const {
+  return !move.is_null() && !move.is_capture() && !move.is_promotion() &&
+         pos_.is_pseudolegal(move);
+}
+
+}  // namespace altair
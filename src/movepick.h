@@ -0,0 +1,186 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+
+#include "move.h"
+#include "movelist.h"
+#include "position.h"
+#include "types.h"
+
+namespace altair {
+
+/**
+ * Scores for quiet moves, indexed by the side to move and the move's source
+ * and destination squares. Moves that have caused cutoffs elsewhere in the
+ * tree score higher and are tried first.
+ */
+using ButterflyHistory =
+    std::array<std::array<std::array<int16_t, kSquareLast>, kSquareLast>,
+               kColorLast>;
+
+/**
+ * The largest magnitude of a history score. Updates shrink as a score
+ * approaches it, so that scores stay in range and recent results count for
+ * more than old ones.
+ */
+constexpr int kHistoryMax = 16384;
+
+/**
+ * Nudges a history score towards kHistoryMax by the given bonus, or towards
+ * -kHistoryMax by a negative one.
+ */
+inline void update_history(int16_t& score, int bonus) {
+  score += bonus - score * std::abs(bonus) / kHistoryMax;
+}
+
+/**
+ * Scores for quiet moves, indexed by the piece that moves and its destination
+ * square.
+ */
+using PieceToHistory = std::array<std::array<int16_t, kSquareLast>, kPieceLast>;
+
+/**
+ * Scores for quiet moves that follow an earlier move, indexed first by the
+ * piece that made the earlier move and its destination square. The search
+ * consults it for the moves one and two plies back, so that moves that have
+ * refuted the opponent's last move, or have followed up on our own, are tried
+ * first.
+ */
+using ContinuationHistory =
+    std::array<std::array<PieceToHistory, kSquareLast>, kPieceLast>;
+
+/**
+ * For each piece and destination square, the quiet move that last refuted
+ * that piece moving to that square.
+ */
+using CounterMoveHistory =
+    std::array<std::array<Move, kSquareLast>, kPieceLast>;
+
+/**
+ * Static exchange evaluation: the material that the side to move gains, in
+ * centipawns, if both sides capture on the move's destination square with
+ * their least valuable attacker for as long as it profits them. Pins are
+ * ignored.
+ */
+int see(const Position& pos, Move move);
+
+/**
+ * Produces the moves of a position one at a time, best first by a guess, for
+ * the search. Moves are generated in stages, each only when the previous one
+ * runs out, so that a node that is cut off by one of its first moves doesn't
+ * pay for generating the rest:
+ *
+ *  1. The move from the transposition table, without generating anything.
+ *  2. Captures and promotions that don't lose material, by MVV-LVA.
+ *  3. The killer moves for the node's ply.
+ *  4. The countermove to the move that led to the node.
+ *  5. Quiet moves, by history and continuation history.
+ *  6. Captures that lose material, by MVV-LVA.
+ *
+ * The moves produced are pseudolegal and must be tested with
+ * Position::is_legal before being made. Each move is produced once.
+ */
+class MovePicker {
+ public:
+  /**
+   * Picks moves for the main search. The TT move must be null or pseudolegal.
+   * The killers and countermove may be null, and are otherwise tried only if
+   * they are pseudolegal quiet moves. The history and the continuation
+   * histories for the moves one and two plies back may also be null.
+   */
+  MovePicker(const Position& pos, Move tt_move,
+             const std::array<Move, 2>& killers, Move countermove,
+             const ButterflyHistory* history,
+             const std::array<const PieceToHistory*, 2>& continuations);
+
+  /**
+   * Picks moves for quiescence search: captures and promotions that don't
+   * lose material, or every move if the side to move is in check.
+   */
+  explicit MovePicker(const Position& pos);
+
+  /**
+   * Returns the next move, or the null move once there are none left.
+   */
+  Move next_move();
+
+  /**
+   * Stops producing quiet moves, including any killers and countermove not yet
+   * produced. Captures that lose material are still produced.
+   */
+  void skip_quiets() { skip_quiets_ = true; }
+
+ private:
+  enum class Stage {
+    kTTMove,
+    kGenerateCaptures,
+    kGoodCaptures,
+    kKillers,
+    kCounterMove,
+    kGenerateQuiets,
+    kQuiets,
+    kBadCaptures,
+    kDone,
+  };
+
+  void score_captures();
+  void score_quiets();
+
+  /**
+   * Moves the highest-scoring of the moves from current_ to the end of the
+   * list to current_, and returns it.
+   */
+  Move pick_best();
+
+  /**
+   * Returns true if the move was produced by an earlier stage.
+   */
+  bool already_tried(Move move) const;
+
+  /**
+   * Returns true if a killer or countermove can be played here as a quiet
+   * move.
+   */
+  bool is_quiet_candidate(Move move) const;
+
+  const Position& pos_;
+  Stage stage_;
+  bool captures_only_;
+  bool skip_quiets_;
+  Move tt_move_;
+  std::array<Move, 2> killers_;
+  size_t killer_index_;
+  Move countermove_;
+  const ButterflyHistory* history_;
+  std::array<const PieceToHistory*, 2> continuations_;
+
+  /**
+   * The moves of the current stage, of which those before current_ have been
+   * produced. Captures that lose material are set aside in bad_captures_.
+   */
+  MoveList moves_;
+  size_t current_;
+  MoveList bad_captures_;
+};
+
+}  // namespace altair
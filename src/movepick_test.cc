@@ -0,0 +1,167 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "movepick.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "movegen.h"
+
+using altair::Move;
+using altair::MoveList;
+using altair::MovePicker;
+using altair::Position;
+
+namespace {
+
+constexpr const char* kKiwipete =
+    "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -";
+
+std::vector<Move> pick_all(MovePicker& picker) {
+  std::vector<Move> moves;
+  for (Move move = picker.next_move(); !move.is_null();
+       move = picker.next_move()) {
+    moves.push_back(move);
+  }
+  return moves;
+}
+
+}  // namespace
+
+TEST(MovePicker, produces_each_move_once) {
+  Position pos;
+  pos.set(kKiwipete);
+  Move tt_move = Move::quiet(altair::E2, altair::D3);
+  Move killer = Move::quiet(altair::A2, altair::A3);
+  MovePicker picker(pos, tt_move, {killer, Move::null()}, Move::null(),
+                    nullptr, {nullptr, nullptr});
+  std::vector<Move> picked = pick_all(picker);
+
+  MoveList moves;
+  altair::movegen::generate_pseudolegal(pos, moves);
+  EXPECT_EQ(moves.size(), picked.size());
+  for (Move move : moves) {
+    EXPECT_EQ(1, std::count(picked.begin(), picked.end(), move))
+        << move.as_uci();
+  }
+  ASSERT_GE(picked.size(), 2);
+  EXPECT_EQ(tt_move, picked[0]);
+
+  // The best capture wins the most material: the bishop takes the bishop.
+  EXPECT_EQ(Move::capture(altair::E2, altair::A6), picked[1]);
+}
+
+TEST(MovePicker, orders_captures_before_killers_before_quiets) {
+  Position pos;
+  pos.set(kKiwipete);
+  Move killer = Move::quiet(altair::A2, altair::A3);
+  MovePicker picker(pos, Move::null(), {killer, Move::null()}, Move::null(),
+                    nullptr, {nullptr, nullptr});
+  std::vector<Move> picked = pick_all(picker);
+  auto killer_at = std::find(picked.begin(), picked.end(), killer);
+  ASSERT_NE(picked.end(), killer_at);
+  for (auto it = picked.begin(); it != killer_at; it++) {
+    EXPECT_TRUE(it->is_capture()) << it->as_uci();
+  }
+}
+
+TEST(MovePicker, orders_countermove_then_quiets_by_history) {
+  Position pos;
+  pos.set(kKiwipete);
+  Move killer = Move::quiet(altair::A2, altair::A3);
+  Move countermove = Move::quiet(altair::G2, altair::G3);
+  Move followup = Move::quiet(altair::C3, altair::B1);
+  Move favored = Move::quiet(altair::B2, altair::B3);
+  auto history = std::make_unique<altair::ButterflyHistory>();
+  altair::update_history(
+      (*history)[altair::kWhite][altair::B2][altair::B3], 4096);
+
+  // Quiets are ordered by the sum of their history and continuation scores.
+  auto continuation = std::make_unique<altair::PieceToHistory>();
+  altair::update_history(
+      (*continuation)[altair::kWhiteKnight][altair::B1], 8192);
+  MovePicker picker(pos, Move::null(), {killer, Move::null()}, countermove,
+                    history.get(), {nullptr, continuation.get()});
+  std::vector<Move> picked = pick_all(picker);
+  auto killer_at = std::find(picked.begin(), picked.end(), killer);
+  ASSERT_NE(picked.end(), killer_at);
+  ASSERT_LT(killer_at + 3, picked.end());
+  EXPECT_EQ(countermove, *(killer_at + 1));
+  EXPECT_EQ(followup, *(killer_at + 2));
+  EXPECT_EQ(favored, *(killer_at + 3));
+  EXPECT_EQ(1, std::count(picked.begin(), picked.end(), countermove));
+}
+
+TEST(MovePicker, skip_quiets_still_produces_captures) {
+  Position pos;
+  pos.set(kKiwipete);
+  Move killer = Move::quiet(altair::A2, altair::A3);
+  MovePicker picker(pos, Move::null(), {killer, Move::null()}, Move::null(),
+                    nullptr, {nullptr, nullptr});
+  Move first = picker.next_move();
+  ASSERT_TRUE(first.is_capture());
+  picker.skip_quiets();
+  std::vector<Move> picked = pick_all(picker);
+
+  MoveList captures;
+  altair::movegen::generate_captures(pos, captures);
+  EXPECT_EQ(captures.size(), picked.size() + 1);
+  for (Move move : picked) {
+    EXPECT_TRUE(move.is_capture()) << move.as_uci();
+  }
+}
+
+TEST(MovePicker, quiescence_skips_losing_captures) {
+  // Taking the pawn on d5 with the queen loses the queen to the knight.
+  Position pos;
+  pos.set("4k3/8/5n2/3p4/8/8/3Q4/4K3 w - - 0 1");
+  MovePicker picker(pos);
+  EXPECT_TRUE(pick_all(picker).empty());
+}
+
+TEST(MovePicker, quiescence_in_check_produces_evasions) {
+  Position pos;
+  pos.set("4k3/8/8/8/8/8/8/r3K3 w - - 0 1");
+  MovePicker picker(pos);
+  std::vector<Move> picked = pick_all(picker);
+  EXPECT_NE(picked.end(), std::find(picked.begin(), picked.end(),
+                                    Move::quiet(altair::E1, altair::E2)));
+}
+
+TEST(SEE, exchanges) {
+  // The knight can take back, but would be lost to the queen, so it doesn't.
+  Position defended;
+  defended.set("4k3/8/5n2/3p4/4P3/8/3Q4/4K3 w - - 0 1");
+  EXPECT_EQ(100,
+            altair::see(defended, Move::capture(altair::E4, altair::D5)));
+
+  Position losing;
+  losing.set("4k3/8/5n2/3p4/8/8/3Q4/4K3 w - - 0 1");
+  EXPECT_EQ(100 - 900,
+            altair::see(losing, Move::capture(altair::D2, altair::D5)));
+
+  // The rook behind the queen joins in once the queen has captured, but only
+  // wins back a rook for it.
+  Position x_ray;
+  x_ray.set("3rk3/8/8/3p4/8/8/3Q4/3RK3 w - - 0 1");
+  EXPECT_EQ(100 - 900 + 500,
+            altair::see(x_ray, Move::capture(altair::D2, altair::D5)));
+}
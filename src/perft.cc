@@ -0,0 +1,230 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "perft.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "log.h"
+#include "movegen.h"
+
+namespace altair::perft {
+
+namespace {
+
+/**
+ * A subtree of the perft, reached from the root by one or two moves.
+ */
+struct Task {
+  size_t root_index;
+  Move first;
+  Move second;
+};
+
+/**
+ * The perft currently being run by the search threads. Everything but the
+ * atomics is written only by prepare, before any thread starts, and by the
+ * thread that claims a task for that task's result.
+ */
+struct Job {
+  unsigned depth;
+  MoveList root_moves;
+  std::vector<Task> tasks;
+  std::vector<uint64_t> results;
+  std::atomic<size_t> next_task;
+
+  /**
+   * The number of subtree counts taken from the cache rather than counted.
+   */
+  std::atomic<uint64_t> cache_hits;
+  std::chrono::time_point<std::chrono::system_clock> start;
+};
+
+Job job;
+
+/**
+ * A cache of subtree counts, shared by all threads. Entries are written
+ * without locking; instead, each stores its key XOR'd with its data, so that
+ * an entry torn by a concurrent write fails to match any key on lookup.
+ *
+ * The cache is cleared before every perft; otherwise a repeated perft would be
+ * answered from the cache without traversing the tree, and its timing would
+ * say nothing about move generation.
+ *
+ * https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+ */
+class Cache {
+ public:
+  Cache() : entries_(kEntryCount) {}
+
+  std::optional<uint64_t> probe(uint64_t key, unsigned depth) const {
+    const Entry& entry = entries_[key % kEntryCount];
+    uint64_t data = entry.data.load(std::memory_order_relaxed);
+    uint64_t check = entry.check.load(std::memory_order_relaxed);
+    if ((check ^ data) != key || (data & kDepthMask) != depth) {
+      return {};
+    }
+
+    return data >> kDepthBits;
+  }
+
+  void store(uint64_t key, unsigned depth, uint64_t count) {
+    Entry& entry = entries_[key % kEntryCount];
+    uint64_t data = (count << kDepthBits) | depth;
+    entry.data.store(data, std::memory_order_relaxed);
+    entry.check.store(key ^ data, std::memory_order_relaxed);
+  }
+
+  void clear() {
+    for (Entry& entry : entries_) {
+      entry.data.store(0, std::memory_order_relaxed);
+      entry.check.store(0, std::memory_order_relaxed);
+    }
+  }
+
+ private:
+  static constexpr size_t kEntryCount = 1 << 20;
+  static constexpr unsigned kDepthBits = 8;
+  static constexpr uint64_t kDepthMask = (1 << kDepthBits) - 1;
+
+  struct Entry {
+    std::atomic<uint64_t> check = 0;
+    std::atomic<uint64_t> data = 0;
+  };
+
+  std::vector<Entry> entries_;
+};
+
+Cache& cache() {
+  static Cache instance;
+  return instance;
+}
+
+}  // namespace
+
+uint64_t count(Position& pos, unsigned depth) {
+  if (depth == 0) {
+    return 1;
+  }
+
+  if (depth > 1) {
+    if (auto cached = cache().probe(pos.hash(), depth)) {
+      job.cache_hits.fetch_add(1, std::memory_order_relaxed);
+      return *cached;
+    }
+  }
+
+  MoveList moves;
+  movegen::generate_legal(pos, moves);
+
+  // Bulk counting: the number of leaves one ply from the horizon is the number
+  // of legal moves, so there's no need to make any of them.
+  if (depth == 1) {
+    return moves.size();
+  }
+
+  uint64_t running_total = 0;
+  for (auto move : moves) {
+    pos.make_move(move);
+    running_total += count(pos, depth - 1);
+    pos.unmake_move(move);
+  }
+
+  cache().store(pos.hash(), depth, running_total);
+  return running_total;
+}
+
+void prepare(const Position& root, unsigned depth) {
+  job.start = std::chrono::system_clock::now();
+  job.depth = depth;
+  job.root_moves.clear();
+  job.tasks.clear();
+  job.next_task.store(0, std::memory_order_relaxed);
+  job.cache_hits.store(0, std::memory_order_relaxed);
+  cache().clear();
+
+  // There are usually too few root moves to keep many threads busy until the
+  // end, so deep enough perfts are split at the second ply instead.
+  Position pos = root;
+  movegen::generate_legal(pos, job.root_moves);
+  for (size_t i = 0; i < job.root_moves.size(); i++) {
+    Move move = job.root_moves[i];
+    if (depth < 3) {
+      job.tasks.push_back(Task{i, move, Move::null()});
+      continue;
+    }
+
+    pos.make_move(move);
+    MoveList replies;
+    movegen::generate_legal(pos, replies);
+    for (Move reply : replies) {
+      job.tasks.push_back(Task{i, move, reply});
+    }
+    pos.unmake_move(move);
+  }
+
+  job.results.assign(job.tasks.size(), 0);
+}
+
+void work(Position& pos) {
+  while (true) {
+    size_t index = job.next_task.fetch_add(1, std::memory_order_relaxed);
+    if (index >= job.tasks.size()) {
+      return;
+    }
+
+    const Task& task = job.tasks[index];
+    unsigned depth = job.depth - 1;
+    pos.make_move(task.first);
+    if (!task.second.is_null()) {
+      pos.make_move(task.second);
+      job.results[index] = count(pos, depth - 1);
+      pos.unmake_move(task.second);
+    } else {
+      job.results[index] = count(pos, depth);
+    }
+    pos.unmake_move(task.first);
+  }
+}
+
+void report() {
+  std::vector<uint64_t> root_counts(job.root_moves.size(), 0);
+  for (size_t i = 0; i < job.tasks.size(); i++) {
+    root_counts[job.tasks[i].root_index] += job.results[i];
+  }
+
+  uint64_t running_total = 0;
+  for (size_t i = 0; i < job.root_moves.size(); i++) {
+    UCI() << job.root_moves[i].as_uci() << ": " << root_counts[i];
+    running_total += root_counts[i];
+  }
+
+  auto end = std::chrono::system_clock::now();
+  std::chrono::duration<double> diff = end - job.start;
+  UCI() << "Nodes searched: " << running_total;
+  UCI() << "Elapsed time: " << diff.count();
+  UCI() << "Nodes per second: "
+        << static_cast<uint64_t>(running_total / diff.count());
+  UCI() << "Cache hits: " << job.cache_hits.load(std::memory_order_relaxed);
+}
+
+}  // namespace altair::perft
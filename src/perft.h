@@ -0,0 +1,62 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+/**
+ * Performance test, move path enumeration: counts the leaves of the move tree
+ * to a given depth, for verifying and benchmarking move generation.
+ *
+ * https://www.chessprogramming.org/Perft
+ */
+
+#include <cstdint>
+
+#include "position.h"
+
+namespace altair::perft {
+
+/**
+ * Counts the leaf nodes of the tree rooted at the given position, on the
+ * current thread.
+ */
+uint64_t count(Position& pos, unsigned depth);
+
+/**
+ * Divides a perft of the given position into tasks that can be distributed
+ * among the search threads, and empties the cache of subtree counts so that
+ * the whole tree is traversed again. Must be called before the threads are
+ * started.
+ */
+void prepare(const Position& pos, unsigned depth);
+
+/**
+ * Called by every search thread, with its own copy of the prepared position;
+ * runs tasks until none remain.
+ */
+void work(Position& pos);
+
+/**
+ * Reports the results of the prepared perft, once all threads have finished
+ * working on it. Helpers write their tasks' results without synchronization,
+ * so this must only be called after Threads::wait_for_helpers has returned,
+ * which orders it after everything the helpers wrote.
+ */
+void report();
+
+}  // namespace altair::perft
@@ -0,0 +1,101 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "perft.h"
+
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "movegen.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "ttable.h"
+
+using altair::Move;
+using altair::Position;
+using altair::SearchLimits;
+using altair::Threads;
+
+class PerftTest : public ::testing::Test {
+  void SetUp() override {
+    Threads::initialize();
+    altair::ttable::initialize(1 /* MB */, Threads::all().size());
+  }
+  void TearDown() override {
+    Threads::set_count(1);
+    altair::ttable::destroy();
+  }
+
+ protected:
+  /**
+   * Runs "go perft" on the search threads, returning what it printed.
+   */
+  std::string perft(const Position& pos, unsigned depth) {
+    SearchLimits limits;
+    limits.perft = depth;
+    ::testing::internal::CaptureStdout();
+    Threads::go(pos, limits);
+    Threads::wait_until_idle();
+    return ::testing::internal::GetCapturedStdout();
+  }
+};
+
+TEST_F(PerftTest, kiwipete_on_four_threads) {
+  Threads::set_count(4);
+  Position pos;
+  pos.set(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  std::istringstream output(perft(pos, 4));
+
+  // The divide lists the root moves in the order they're generated in, each
+  // with the count of its own subtree, however the work was split up. Under
+  // ThreadSanitizer, this also checks that the counts helpers wrote are
+  // visible to the main thread when it reports them.
+  altair::MoveList moves;
+  altair::movegen::generate_legal(pos, moves);
+  std::string line;
+  for (Move move : moves) {
+    pos.make_move(move);
+    std::string expected = move.as_uci() + ": " +
+                           std::to_string(altair::perft::count(pos, 3));
+    pos.unmake_move(move);
+    ASSERT_TRUE(std::getline(output, line));
+    EXPECT_EQ(expected, line);
+  }
+
+  ASSERT_TRUE(std::getline(output, line));
+  EXPECT_EQ("Nodes searched: 4085603", line);
+}
+
+TEST_F(PerftTest, repeated_perft_traverses_the_tree) {
+  Position pos;
+  pos.set(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+
+  // On one thread, the cache is hit only by transpositions within the tree; a
+  // second run that found the first one's counts in the cache would hit it
+  // once for every subtree it was split into.
+  std::string first = perft(pos, 4);
+  std::string second = perft(pos, 4);
+  size_t hits = first.find("Cache hits: ");
+  ASSERT_NE(std::string::npos, hits);
+  EXPECT_EQ(first.substr(hits), second.substr(second.find("Cache hits: ")));
+  EXPECT_NE("Cache hits: 0\n", first.substr(hits));
+}
@@ -213,6 +213,19 @@ class FenParser {
 
 }  // anonymous namespace
 
+Position& Position::operator=(const Position& other) {
+  pieces_by_square_ = other.pieces_by_square_;
+  boards_by_piece_ = other.boards_by_piece_;
+  boards_by_color_ = other.boards_by_color_;
+  side_to_move_ = other.side_to_move_;
+  std::copy(other.states_.begin(),
+            other.states_.begin() + other.state_index_ + 1, states_.begin());
+  state_index_ = other.state_index_;
+  ply_ = other.ply_;
+  hash_ = other.hash_;
+  return *this;
+}
+
 void Position::set(std::string_view fen_str) {
   FenParser parser(fen_str);
   parser.parse(*this);
@@ -303,17 +316,79 @@ std::string Position::fen() const {
   return ss.str();
 }
 
+uint64_t Position::key_after(Move mov) const {
+  // This mirrors every change that make_move makes to the hash.
+  Color us = side_to_move_;
+  Square from = mov.source();
+  Square to = mov.destination();
+  Piece p = piece_at(from);
+  uint64_t key = hash_;
+  zobrist::modify_piece(&key, from, p);
+  if (mov.is_capture()) {
+    Square target_square = to;
+    if (mov.is_en_passant()) {
+      Direction down = us == kWhite ? kDirectionSouth : kDirectionNorth;
+      target_square = towards(to, down);
+    }
+
+    zobrist::modify_piece(&key, target_square, piece_at(target_square));
+  }
+
+  if (mov.is_castle()) {
+    Square rook_source = mov.is_kingside_castle() ? (us == kWhite ? H1 : H8)
+                                                  : (us == kWhite ? A1 : A8);
+    Square rook_destination = mov.is_kingside_castle()
+                                  ? towards(to, kDirectionWest)
+                                  : towards(to, kDirectionEast);
+    Piece rook = make_piece(kRook, us);
+    zobrist::modify_piece(&key, rook_source, rook);
+    zobrist::modify_piece(&key, rook_destination, rook);
+  }
+
+  if (mov.is_promotion()) {
+    p = make_piece(mov.promotion_piece(), us);
+  }
+  zobrist::modify_piece(&key, to, p);
+
+  if (kind_of(p) == kKing) {
+    if (can_castle_kingside(us)) {
+      zobrist::modify_kingside_castle(&key, us);
+    }
+    if (can_castle_queenside(us)) {
+      zobrist::modify_queenside_castle(&key, us);
+    }
+  } else if (kind_of(p) == kRook) {
+    if (can_castle_kingside(us) && from == (us == kWhite ? H1 : H8)) {
+      zobrist::modify_kingside_castle(&key, us);
+    } else if (can_castle_queenside(us) && from == (us == kWhite ? A1 : A8)) {
+      zobrist::modify_queenside_castle(&key, us);
+    }
+  }
+
+  zobrist::modify_side_to_move(&key);
+  Square ep_square = kNoSquare;
+  if (mov.is_double_pawn_push()) {
+    Direction down = us == kWhite ? kDirectionSouth : kDirectionNorth;
+    ep_square = towards(to, down);
+  }
+  zobrist::modify_en_passant(&key, en_passant_square(), ep_square);
+  return key;
+}
+
 void Position::make_move(Move mov) {
   Color us = side_to_move_;
   Square to = mov.destination();
   Square from = mov.source();
+  states_[state_index_].hash = hash_;
   Piece p = remove_piece(from);
   CHECK(p != kNoPiece) << "no piece at source square";
   CHECK(color_of(p) == us) << "moving piece that does not belong to us";
 
-  states_.emplace_back();
-  const IrreversibleState& old_state = states_[states_.size() - 2];
-  IrreversibleState& new_state = states_.back();
+  CHECK(state_index_ + 1 < kMaxStates) << "state stack overflow";
+  const IrreversibleState& old_state = states_[state_index_];
+  IrreversibleState& new_state = states_[++state_index_];
+  new_state.ep_square = kNoSquare;
+  new_state.captured_piece = kNoPiece;
   if (mov.is_capture()) {
     Square target_square = to;
     if (mov.is_en_passant()) {
@@ -358,6 +433,7 @@ void Position::make_move(Move mov) {
   ply_++;
   new_state.castling = old_state.castling;
   new_state.halfmove_clock = old_state.halfmove_clock + 1;
+  new_state.plies_from_null = old_state.plies_from_null + 1;
   if (kind_of(p) == kPawn || mov.is_capture() || mov.is_promotion()) {
     new_state.halfmove_clock = 0;
   }
@@ -365,9 +441,13 @@ void Position::make_move(Move mov) {
   if (kind_of(p) == kKing) {
     // King moves invalidate all castling rights.
     CastlingRights mask = us == kWhite ? kCastleWhite : kCastleBlack;
+    if (can_castle_kingside(us)) {
+      zobrist::modify_kingside_castle(&hash_, us);
+    }
+    if (can_castle_queenside(us)) {
+      zobrist::modify_queenside_castle(&hash_, us);
+    }
     new_state.castling &= ~mask;
-    zobrist::modify_kingside_castle(&hash_, us);
-    zobrist::modify_queenside_castle(&hash_, us);
   } else if (kind_of(p) == kRook) {
     // Rook moves invalidate castling rights on the side of the board that the
     // rook originated.
@@ -392,11 +472,11 @@ void Position::make_move(Move mov) {
     Direction down = us == kWhite ? kDirectionSouth : kDirectionNorth;
     new_state.ep_square = towards(mov.destination(), down);
   }
+  zobrist::modify_en_passant(&hash_, old_state.ep_square, new_state.ep_square);
 }
 
 void Position::unmake_move(Move mov) {
-  IrreversibleState state = states_.back();
-  states_.pop_back();
+  const IrreversibleState& state = states_[state_index_--];
   ply_--;
   Color us = !side_to_move();
   Square to = mov.destination();
@@ -436,6 +516,60 @@ void Position::unmake_move(Move mov) {
   }
 
   side_to_move_ = !side_to_move_;
+
+  // Moving the pieces back updated the hash along the way, but it's cheaper to
+  // restore it than to also undo the side to move, castling, and en passant
+  // changes.
+  hash_ = states_[state_index_].hash;
+}
+
+bool Position::is_repetition() const {
+  // Only positions since the last irreversible move can repeat this one, and
+  // only those with the same side to move.
+  const IrreversibleState& state = states_[state_index_];
+  size_t reach = std::min<size_t>(
+      {static_cast<size_t>(state.halfmove_clock),
+       static_cast<size_t>(state.plies_from_null), state_index_});
+  for (size_t back = 4; back <= reach; back += 2) {
+    if (states_[state_index_ - back].hash == hash_) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void Position::discard_history() {
+  size_t keep = std::min<size_t>(
+      {static_cast<size_t>(states_[state_index_].halfmove_clock), kMaxHistory,
+       state_index_});
+  size_t first = state_index_ - keep;
+  std::copy(states_.begin() + first, states_.begin() + state_index_ + 1,
+            states_.begin());
+  state_index_ = keep;
+}
+
+void Position::make_null_move() {
+  CHECK(!is_check(side_to_move_)) << "null move while in check";
+  CHECK(state_index_ + 1 < kMaxStates) << "state stack overflow";
+  states_[state_index_].hash = hash_;
+  const IrreversibleState& old_state = states_[state_index_];
+  IrreversibleState& new_state = states_[++state_index_];
+  new_state.ep_square = kNoSquare;
+  new_state.castling = old_state.castling;
+  new_state.halfmove_clock = old_state.halfmove_clock + 1;
+  new_state.plies_from_null = 0;
+  new_state.captured_piece = kNoPiece;
+  ply_++;
+  side_to_move_ = !side_to_move_;
+  zobrist::modify_side_to_move(&hash_);
+  zobrist::modify_en_passant(&hash_, old_state.ep_square, kNoSquare);
+}
+
+void Position::unmake_null_move() {
+  state_index_--;
+  ply_--;
+  side_to_move_ = !side_to_move_;
+  hash_ = states_[state_index_].hash;
 }
 
 Bitboard Position::squares_attacking(Square target, Color side) const {
@@ -462,4 +596,301 @@ bool Position::is_check(Color side) const {
   return !squares_attacking(king, !side).empty();
 }
 
+bool Position::is_legal(Move mov) const {
+  if (mov.is_castle()) {
+    // The move generator only produces castles when the king starts, passes
+    // through, and ends on unattacked squares.
+    return true;
+  }
+
+  Color us = side_to_move_;
+  Color them = !us;
+  Square from = mov.source();
+  Square to = mov.destination();
+  Square king = kind_of(piece_at(from)) == kKing
+                    ? to
+                    : pieces(us, kKing).expect_one();
+  Square target = to;
+  if (mov.is_en_passant()) {
+    Direction down = us == kWhite ? kDirectionSouth : kDirectionNorth;
+    target = towards(to, down);
+  }
+
+  // Look for attacks on the king in the board as it would be after the move,
+  // ignoring any piece that the move captures.
+  Bitboard captured;
+  captured.set(target);
+  Bitboard occupancy = pieces(us) | pieces(them);
+  occupancy.unset(from);
+  occupancy.unset(target);
+  occupancy.set(to);
+  Bitboard queens = pieces(them, kQueen);
+  Bitboard attackers =
+      (attacks::pawns(king, us) & pieces(them, kPawn)) |
+      (attacks::knights(king) & pieces(them, kKnight)) |
+      (attacks::bishops(king, occupancy) & (pieces(them, kBishop) | queens)) |
+      (attacks::rooks(king, occupancy) & (pieces(them, kRook) | queens)) |
+      (attacks::kings(king) & pieces(them, kKing));
+  return (attackers & ~captured).empty();
+}
+
+bool Position::gives_check(Move mov) const {
+  Color us = side_to_move_;
+  Color them = !us;
+  Square king = pieces(them, kKing).expect_one();
+  Square from = mov.source();
+  Square to = mov.destination();
+
+  // The board as it would be after the move, as far as checks are concerned.
+  Bitboard occupancy = pieces(us) | pieces(them);
+  occupancy.unset(from);
+  occupancy.set(to);
+  if (mov.is_en_passant()) {
+    Direction down = us == kWhite ? kDirectionSouth : kDirectionNorth;
+    occupancy.unset(towards(to, down));
+  }
+
+  if (mov.is_castle()) {
+    // Only the rook can give check; the king can't.
+    Square rook_source = mov.is_kingside_castle() ? (us == kWhite ? H1 : H8)
+                                                  : (us == kWhite ? A1 : A8);
+    Square rook_destination = mov.is_kingside_castle()
+                                  ? towards(to, kDirectionWest)
+                                  : towards(to, kDirectionEast);
+    occupancy.unset(rook_source);
+    occupancy.set(rook_destination);
+    return attacks::rooks(rook_destination, occupancy).test(king);
+  }
+
+  PieceKind kind =
+      mov.is_promotion() ? mov.promotion_piece() : kind_of(piece_at(from));
+  Bitboard direct;
+  switch (kind) {
+    case kPawn:
+      direct = attacks::pawns(to, us);
+      break;
+    case kKnight:
+      direct = attacks::knights(to);
+      break;
+    case kBishop:
+      direct = attacks::bishops(to, occupancy);
+      break;
+    case kRook:
+      direct = attacks::rooks(to, occupancy);
+      break;
+    case kQueen:
+      direct = attacks::queens(to, occupancy);
+      break;
+    default:
+      break;
+  }
+  if (direct.test(king)) {
+    return true;
+  }
+
+  // Any other slider whose line to the king the move opens gives check.
+  Bitboard queens = pieces(us, kQueen);
+  Bitboard diagonal = pieces(us, kBishop) | queens;
+  Bitboard straight = pieces(us, kRook) | queens;
+  diagonal.unset(from);
+  straight.unset(from);
+  return !((attacks::bishops(king, occupancy) & diagonal) |
+           (attacks::rooks(king, occupancy) & straight))
+              .empty();
+}
+
+bool Position::may_give_quiet_check() const {
+  Color us = side_to_move_;
+  Color them = !us;
+  Square king = pieces(them, kKing).expect_one();
+  Bitboard occupancy = pieces(us) | pieces(them);
+  Bitboard empty = ~occupancy;
+
+  // Castling moves a rook, which may land on a checking square.
+  if (can_castle_kingside(us) || can_castle_queenside(us)) {
+    return true;
+  }
+
+  // Direct checks: a piece moving to an empty square from which it would
+  // attack the king.
+  Bitboard knight_checks = attacks::knights(king) & empty;
+  Bitboard diagonal_checks = attacks::bishops(king, occupancy) & empty;
+  Bitboard straight_checks = attacks::rooks(king, occupancy) & empty;
+  Bitboard knights = pieces(us, kKnight);
+  while (!knights.empty()) {
+    if (!(attacks::knights(knights.pop()) & knight_checks).empty()) {
+      return true;
+    }
+  }
+  Bitboard bishops = pieces(us, kBishop);
+  while (!bishops.empty()) {
+    if (!(attacks::bishops(bishops.pop(), occupancy) & diagonal_checks)
+             .empty()) {
+      return true;
+    }
+  }
+  Bitboard rooks = pieces(us, kRook);
+  while (!rooks.empty()) {
+    if (!(attacks::rooks(rooks.pop(), occupancy) & straight_checks).empty()) {
+      return true;
+    }
+  }
+  Bitboard queens = pieces(us, kQueen);
+  while (!queens.empty()) {
+    if (!(attacks::queens(queens.pop(), occupancy) &
+          (diagonal_checks | straight_checks))
+             .empty()) {
+      return true;
+    }
+  }
+
+  Direction down = us == kWhite ? kDirectionSouth : kDirectionNorth;
+  Rank back_rank = us == kWhite ? kRank1 : kRank8;
+  Rank push_rank = us == kWhite ? kRank3 : kRank6;
+  Bitboard pawns = pieces(us, kPawn);
+  Bitboard pawn_checks = attacks::pawns(king, them) & empty;
+  while (!pawn_checks.empty()) {
+    Square target = pawn_checks.pop();
+    if (rank_of(target) == back_rank) {
+      continue;
+    }
+    Square behind = towards(target, down);
+    if (pawns.test(behind) ||
+        (rank_of(behind) == push_rank && empty.test(behind) &&
+         pawns.test(towards(behind, down)))) {
+      return true;
+    }
+  }
+
+  // Discovered checks: one of our pieces is all that stands between one of
+  // our sliders and the king.
+  Bitboard sliders =
+      (attacks::bishops(king, Bitboard()) &
+       (pieces(us, kBishop) | pieces(us, kQueen))) |
+      (attacks::rooks(king, Bitboard()) &
+       (pieces(us, kRook) | pieces(us, kQueen)));
+  while (!sliders.empty()) {
+    Bitboard blockers = attacks::between(sliders.pop(), king) & occupancy;
+    if (blockers.size() == 1 && !(blockers & pieces(us)).empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Position::is_pseudolegal(Move mov) const {
+  if (mov.is_null()) {
+    return false;
+  }
+
+  Color us = side_to_move_;
+  Color them = !us;
+  Square from = mov.source();
+  Square to = mov.destination();
+  Piece piece = piece_at(from);
+  if (piece == kNoPiece || color_of(piece) != us || pieces(us).test(to)) {
+    return false;
+  }
+
+  // Work out the move that the generator would produce for this piece moving
+  // to this square, if any, and compare it with the given move; this checks
+  // the move's flags as well as its squares.
+  Bitboard occupancy = pieces(us) | pieces(them);
+  bool capture = pieces(them).test(to);
+  PieceKind kind = kind_of(piece);
+  Move expected = Move::null();
+  switch (kind) {
+    case kPawn: {
+      Direction up = us == kWhite ? kDirectionNorth : kDirectionSouth;
+      Rank start = us == kWhite ? kRank2 : kRank7;
+      Rank last = us == kWhite ? kRank8 : kRank1;
+      bool promotes = rank_of(to) == last;
+      if (attacks::pawns(from, us).test(to)) {
+        if (to == en_passant_square()) {
+          expected = Move::en_passant(from, to);
+        } else if (capture && promotes) {
+          expected = Move::promotion_capture(from, to, mov.promotion_piece());
+        } else if (capture) {
+          expected = Move::capture(from, to);
+        }
+      } else if (!capture && to == towards(from, up)) {
+        expected = promotes ? Move::promotion(from, to, mov.promotion_piece())
+                            : Move::quiet(from, to);
+      } else if (!capture && rank_of(from) == start &&
+                 to == towards(towards(from, up), up) &&
+                 !occupancy.test(towards(from, up))) {
+        expected = Move::double_pawn_push(from, to);
+      }
+      break;
+    }
+    case kKing:
+      if (mov.is_castle()) {
+        return is_pseudolegal_castle(mov);
+      }
+      [[fallthrough]];
+    default: {
+      Bitboard destinations;
+      switch (kind) {
+        case kKnight:
+          destinations = attacks::knights(from);
+          break;
+        case kBishop:
+          destinations = attacks::bishops(from, occupancy);
+          break;
+        case kRook:
+          destinations = attacks::rooks(from, occupancy);
+          break;
+        case kQueen:
+          destinations = attacks::queens(from, occupancy);
+          break;
+        default:
+          destinations = attacks::kings(from);
+          break;
+      }
+      if (destinations.test(to)) {
+        expected = capture ? Move::capture(from, to) : Move::quiet(from, to);
+      }
+      break;
+    }
+  }
+
+  return !expected.is_null() && expected == mov;
+}
+
+bool Position::is_pseudolegal_castle(Move mov) const {
+  // The same conditions that the move generator checks before producing a
+  // castle; see generate_moves in movegen.cc.
+  Color us = side_to_move_;
+  Square king = mov.source();
+  Rank home = us == kWhite ? kRank1 : kRank8;
+  if (king != square_of(kFileE, home) || is_check(us)) {
+    return false;
+  }
+
+  Piece rook = make_piece(kRook, us);
+  Bitboard occupancy = pieces(us) | pieces(!us);
+  Square one, two;
+  if (mov.is_kingside_castle()) {
+    if (!can_castle_kingside(us) || piece_at(square_of(kFileH, home)) != rook) {
+      return false;
+    }
+    one = towards(king, kDirectionEast);
+    two = towards(one, kDirectionEast);
+  } else {
+    Square three = towards(towards(towards(king, kDirectionWest),
+                                   kDirectionWest),
+                           kDirectionWest);
+    if (!can_castle_queenside(us) ||
+        piece_at(square_of(kFileA, home)) != rook || occupancy.test(three)) {
+      return false;
+    }
+    one = towards(king, kDirectionWest);
+    two = towards(one, kDirectionWest);
+  }
+
+  return mov.destination() == two && !occupancy.test(one) &&
+         !occupancy.test(two) && squares_attacking(one, !us).empty() &&
+         squares_attacking(two, !us).empty();
+}
+
 }  // namespace altair
\ No newline at end of file
@@ -19,9 +19,9 @@
 #pragma once
 
 #include <array>
+#include <cstddef>
 #include <cstdint>
 #include <string_view>
-#include <vector>
 
 #include "bitboard.h"
 #include "move.h"
@@ -35,12 +35,38 @@ namespace altair {
  * the move alone.
  */
 struct IrreversibleState {
-  Square ep_square = kNoSquare;
+  Square ep_square;
   CastlingRights castling;
   int halfmove_clock;
-  Piece captured_piece = kNoPiece;
+
+  /**
+   * The number of moves made since the last null move, which no repetition can
+   * reach back past.
+   */
+  int plies_from_null;
+  Piece captured_piece;
+
+  /**
+   * The position's hash, saved when a move is made from this state so that
+   * unmake_move can restore it.
+   */
+  uint64_t hash;
 };
 
+/**
+ * The most states from before the current position that discard_history keeps.
+ * Older positions can't matter: a position can only repeat if no pawn has
+ * moved and nothing has been captured since, and once that has gone on for
+ * 100 plies, the game is drawn by the fifty-move rule anyway.
+ */
+constexpr size_t kMaxHistory = 100;
+
+/**
+ * The number of states that a Position has room for: the history kept by
+ * discard_history, followed by the deepest search.
+ */
+constexpr size_t kMaxStates = 512;
+
 /**
  * The representation of a board position in Altair.
  */
@@ -51,11 +77,19 @@ class Position {
         boards_by_piece_(),
         boards_by_color_(),
         side_to_move_(kWhite),
-        states_(),
-        ply_(0) {
-    states_.emplace_back();
+        state_index_(0),
+        ply_(0),
+        hash_(0) {
+    states_[0] = IrreversibleState{kNoSquare, kNoCastle, 0, 0, kNoPiece, 0};
   }
 
+  /**
+   * Copies a position. Only the states up to the current one are copied, so
+   * the cost is bounded by the number of moves made rather than kMaxStates.
+   */
+  Position(const Position& other) { *this = other; }
+  Position& operator=(const Position& other);
+
   /**
    * Sets the position to the given FEN string.
    *
@@ -90,12 +124,39 @@ class Position {
    */
   void unmake_move(Move mov);
 
+  /**
+   * Forgets the states from before the last move that reset the halfmove
+   * clock, or from more than kMaxHistory moves ago, so that any number of moves
+   * can be played into a position without filling its stack. The moves made
+   * before then can no longer be unmade.
+   */
+  void discard_history();
+
+  /**
+   * Passes the turn to the other side without moving a piece, as the search
+   * does to test whether the side to move's position is strong enough that it
+   * would still be good if it could move twice. The side to move must not be
+   * in check.
+   */
+  void make_null_move();
+
+  /**
+   * Un-applies a null move, restoring the position to its state before it.
+   */
+  void unmake_null_move();
+
   void set_en_passant_square(Square square);
   Square en_passant_square() const;
   void set_side_to_move(Color side);
   Color side_to_move() const;
   void set_castling_rights(CastlingRights rights);
   CastlingRights castling_rights() const;
+  /**
+   * Returns whether this position occurred earlier in the moves that led to
+   * it, as far back as its history reaches.
+   */
+  bool is_repetition() const;
+
   void set_halfmove_clock(int clock);
   int halfmove_clock() const;
   void set_ply(int ply);
@@ -114,6 +175,42 @@ class Position {
    */
   bool is_check(Color side) const;
 
+  /**
+   * Returns whether the given pseudolegal move is legal; that is, whether it
+   * leaves the moving side's king out of check. This doesn't modify the
+   * position and is much cheaper than making the move and testing for check.
+   */
+  bool is_legal(Move mov) const;
+
+  /**
+   * Returns whether the given pseudolegal move checks the opponent's king,
+   * either directly or by uncovering an attack from another piece. Like
+   * is_legal, this doesn't make the move.
+   */
+  bool gives_check(Move mov) const;
+
+  /**
+   * Returns false if no quiet move of the side to move can give check. Only
+   * looks at which pieces could reach a checking square or uncover an attack
+   * on the king, not at whether they can legally do so, so it may return true
+   * when there are no such moves.
+   */
+  bool may_give_quiet_check() const;
+
+  /**
+   * Returns whether the given move is one that the move generator could
+   * produce in this position, without generating any moves. Moves from
+   * elsewhere, such as the transposition table, must pass this test before
+   * being tested for legality or made.
+   */
+  bool is_pseudolegal(Move mov) const;
+
+  /**
+   * Returns the hash that this position will have after the given move is
+   * made, without making it.
+   */
+  uint64_t key_after(Move mov) const;
+
   /**
    * Returns a bitboard of all pieces belonging to the given side.
    */
@@ -131,6 +228,8 @@ class Position {
   uint64_t hash() const;
 
  private:
+  bool is_pseudolegal_castle(Move mov) const;
+
   /**
    * Board representation.
    */
@@ -138,54 +237,65 @@ class Position {
   std::array<Bitboard, 12> boards_by_piece_;
   std::array<Bitboard, 2> boards_by_color_;
   Color side_to_move_;
-  std::vector<IrreversibleState> states_;
+
+  /**
+   * A stack of states, one per move made; states_[state_index_] is the
+   * current state. The stack is preallocated so that making and unmaking moves
+   * never allocates.
+   */
+  std::array<IrreversibleState, kMaxStates> states_;
+  size_t state_index_;
   int ply_;
   uint64_t hash_;
 };
 
 inline void Position::set_en_passant_square(Square square) {
   Square old_square = en_passant_square();
-  states_.back().ep_square = square;
+  states_[state_index_].ep_square = square;
   zobrist::modify_en_passant(&hash_, old_square, square);
 }
 
 inline Square Position::en_passant_square() const {
-  return states_.back().ep_square;
+  return states_[state_index_].ep_square;
 }
 
 inline void Position::set_side_to_move(Color side) {
+  if (side != side_to_move_) {
+    zobrist::modify_side_to_move(&hash_);
+  }
   side_to_move_ = side;
-  zobrist::modify_side_to_move(&hash_);
 }
 
 inline Color Position::side_to_move() const { return side_to_move_; }
 
 inline void Position::set_castling_rights(CastlingRights rights) {
-  Color us = side_to_move();
-  CastlingRights kingside_castle =
-      us == kWhite ? kCastleWhiteKingside : kCastleBlackKingside;
-  CastlingRights queenside_castle =
-      us == kWhite ? kCastleWhiteQueenside : kCastleBlackQueenside;
   CastlingRights old_castling_rights = castling_rights();
-  if ((old_castling_rights & kingside_castle) != (rights & kingside_castle)) {
-    zobrist::modify_kingside_castle(&hash_, us);
-  }
-  if ((old_castling_rights & queenside_castle) != (rights & queenside_castle)) {
-    zobrist::modify_queenside_castle(&hash_, us);
+  for (Color color : {kWhite, kBlack}) {
+    CastlingRights kingside_castle =
+        color == kWhite ? kCastleWhiteKingside : kCastleBlackKingside;
+    CastlingRights queenside_castle =
+        color == kWhite ? kCastleWhiteQueenside : kCastleBlackQueenside;
+    if ((old_castling_rights & kingside_castle) != (rights & kingside_castle)) {
+      zobrist::modify_kingside_castle(&hash_, color);
+    }
+    if ((old_castling_rights & queenside_castle) !=
+        (rights & queenside_castle)) {
+      zobrist::modify_queenside_castle(&hash_, color);
+    }
   }
-  states_.back().castling = rights;
+  states_[state_index_].castling = rights;
 }
 
 inline CastlingRights Position::castling_rights() const {
-  return states_.back().castling;
+  return states_[state_index_].castling;
 }
 
 inline void Position::set_halfmove_clock(int clock) {
-  states_.back().halfmove_clock = clock;
+  states_[state_index_].halfmove_clock = clock;
 }
 
 inline int Position::halfmove_clock() const {
-  return states_.back().halfmove_clock;
+  return states_[state_index_].halfmove_clock;
 }
 
 inline void Position::set_ply(int ply) { ply_ = ply; }
@@ -18,15 +18,59 @@
 
 #include "position.h"
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 #include "bitboard.h"
 #include "gtest/gtest.h"
 #include "move.h"
+#include "movegen.h"
 #include "types.h"
 
 using altair::Bitboard;
 using altair::Move;
 using altair::Position;
 
+namespace {
+
+void check_key_after(Position& pos, unsigned depth) {
+  altair::MoveList moves;
+  altair::movegen::generate_legal(pos, moves);
+  for (Move mov : moves) {
+    uint64_t predicted = pos.key_after(mov);
+    pos.make_move(mov);
+    ASSERT_EQ(predicted, pos.hash()) << mov.as_uci() << " in " << pos.fen();
+    if (depth > 1) {
+      check_key_after(pos, depth - 1);
+    }
+    pos.unmake_move(mov);
+  }
+}
+
+void check_gives_check(Position& pos, unsigned depth) {
+  bool may_check_quietly = pos.may_give_quiet_check();
+  altair::MoveList moves;
+  altair::movegen::generate_legal(pos, moves);
+  for (Move mov : moves) {
+    bool predicted = pos.gives_check(mov);
+    pos.make_move(mov);
+    bool checks = pos.is_check(pos.side_to_move());
+    pos.unmake_move(mov);
+    ASSERT_EQ(checks, predicted) << mov.as_uci() << " in " << pos.fen();
+    if (checks && !mov.is_capture() && !mov.is_promotion()) {
+      ASSERT_TRUE(may_check_quietly) << mov.as_uci() << " in " << pos.fen();
+    }
+    if (depth > 1) {
+      pos.make_move(mov);
+      check_gives_check(pos, depth - 1);
+      pos.unmake_move(mov);
+    }
+  }
+}
+
+}  // namespace
+
 TEST(Position, piece_smoke) {
   Position pos;
   ASSERT_EQ(pos.piece_at(altair::A4), altair::kNoPiece);
@@ -133,4 +177,242 @@ TEST(Position, fen_set_has_nonzero_hash) {
   pos.set("8/p3kp2/1n6/8/3K4/8/P4P2/8 w - - 4 59");
   size_t hash = std::hash<Position>{}(pos);
   ASSERT_NE(hash, 0);
-}
\ No newline at end of file
+}
+
+TEST(Position, is_legal_pinned_piece) {
+  Position pos;
+  pos.set("4k3/4r3/8/8/8/8/4B3/4K3 w - - 0 1");
+  ASSERT_FALSE(pos.is_legal(Move::quiet(altair::E2, altair::D3)));
+  ASSERT_TRUE(pos.is_legal(Move::quiet(altair::E1, altair::D1)));
+}
+
+TEST(Position, is_legal_en_passant_discovery) {
+  Position pos;
+  pos.set("8/8/8/KPp4r/8/8/8/7k w - c6 0 1");
+  ASSERT_FALSE(pos.is_legal(Move::en_passant(altair::B5, altair::C6)));
+  ASSERT_TRUE(pos.is_legal(Move::quiet(altair::B5, altair::B6)));
+}
+
+TEST(Position, is_legal_king_stays_on_check_ray) {
+  Position pos;
+  pos.set("4k3/8/8/8/8/8/8/r3K3 w - - 0 1");
+  ASSERT_FALSE(pos.is_legal(Move::quiet(altair::E1, altair::F1)));
+  ASSERT_TRUE(pos.is_legal(Move::quiet(altair::E1, altair::E2)));
+}
+
+TEST(Position, unmake_restores_hash) {
+  Position pos;
+  pos.set("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -");
+  size_t hash = std::hash<Position>{}(pos);
+  Move moves[] = {Move::double_pawn_push(altair::A2, altair::A4),
+                  Move::kingside_castle(altair::E1, altair::G1),
+                  Move::capture(altair::E5, altair::F7)};
+  for (Move mov : moves) {
+    pos.make_move(mov);
+    pos.unmake_move(mov);
+    ASSERT_EQ(hash, std::hash<Position>{}(pos));
+  }
+}
+
+TEST(Position, transposition_matches_fen_hash) {
+  Position moved;
+  moved.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  moved.make_move(Move::double_pawn_push(altair::E2, altair::E4));
+  moved.make_move(Move::quiet(altair::G8, altair::F6));
+  moved.make_move(Move::quiet(altair::E1, altair::E2));
+
+  Position fen;
+  fen.set("rnbqkb1r/pppppppp/5n2/8/4P3/8/PPPPKPPP/RNBQ1BNR b kq - 1 2");
+  ASSERT_EQ(std::hash<Position>{}(fen), std::hash<Position>{}(moved));
+}
+
+TEST(Position, en_passant_and_castling_keys_differ) {
+  // Trading white's queenside castling right for an en passant square on the
+  // a-file must change the hash.
+  Position castling;
+  castling.set("4k3/8/8/8/Pp6/8/8/R3K3 b Q - 0 1");
+  Position en_passant;
+  en_passant.set("4k3/8/8/8/Pp6/8/8/R3K3 b - a3 0 1");
+  ASSERT_NE(castling.hash(), en_passant.hash());
+}
+
+TEST(Position, copy_keeps_move_history) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  std::string fen = pos.fen();
+  Move e4 = Move::double_pawn_push(altair::E2, altair::E4);
+  Move d5 = Move::double_pawn_push(altair::D7, altair::D5);
+  pos.make_move(e4);
+  pos.make_move(d5);
+
+  Position copy = pos;
+  ASSERT_EQ(pos.fen(), copy.fen());
+  copy.unmake_move(d5);
+  copy.unmake_move(e4);
+  ASSERT_EQ(fen, copy.fen());
+  ASSERT_EQ(altair::D6, pos.en_passant_square());
+}
+
+TEST(Position, discard_history_makes_room_for_long_games) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  std::string fen = pos.fen();
+  Move nf3 = Move::quiet(altair::G1, altair::F3);
+  Move nf6 = Move::quiet(altair::G8, altair::F6);
+  Move ng1 = Move::quiet(altair::F3, altair::G1);
+  Move ng8 = Move::quiet(altair::F6, altair::G8);
+  for (int i = 0; i < 1000; i++) {
+    for (Move move : {nf3, nf6, ng1, ng8}) {
+      pos.make_move(move);
+      pos.discard_history();
+    }
+  }
+  ASSERT_EQ(4000, pos.halfmove_clock());
+
+  // The kept history still unmakes, and leaves room for a search.
+  for (size_t i = 0; i < altair::kMaxHistory / 4; i++) {
+    for (Move move : {ng8, ng1, nf6, nf3}) {
+      pos.unmake_move(move);
+    }
+  }
+  for (size_t i = 0; i < (altair::kMaxStates - altair::kMaxHistory) / 4 - 1;
+       i++) {
+    for (Move move : {nf3, nf6, ng1, ng8}) {
+      pos.make_move(move);
+    }
+  }
+}
+
+TEST(Position, is_repetition) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  Move nf3 = Move::quiet(altair::G1, altair::F3);
+  Move nf6 = Move::quiet(altair::G8, altair::F6);
+  Move ng1 = Move::quiet(altair::F3, altair::G1);
+  Move ng8 = Move::quiet(altair::F6, altair::G8);
+  for (Move move : {nf3, nf6, ng1}) {
+    pos.make_move(move);
+    ASSERT_FALSE(pos.is_repetition());
+  }
+  pos.make_move(ng8);
+  ASSERT_TRUE(pos.is_repetition());
+}
+
+TEST(Position, null_move_ends_repetition_history) {
+  Position pos;
+  pos.set("4k3/8/8/8/8/8/8/4K3 w - - 0 1");
+  pos.make_move(Move::quiet(altair::E1, altair::D1));
+  pos.make_null_move();
+  pos.make_move(Move::quiet(altair::D1, altair::E1));
+  pos.make_null_move();
+  ASSERT_FALSE(pos.is_repetition());
+}
+
+TEST(Position, key_after_matches_make_move) {
+  for (const char* fen : {
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+       }) {
+    Position pos;
+    pos.set(fen);
+    check_key_after(pos, 3);
+  }
+}
+
+TEST(Position, null_move_passes_turn) {
+  Position pos;
+  pos.set("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3");
+  std::string fen = pos.fen();
+  uint64_t hash = pos.hash();
+  pos.make_null_move();
+
+  Position passed;
+  passed.set("rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR b KQkq - 1 3");
+  ASSERT_EQ(altair::kBlack, pos.side_to_move());
+  ASSERT_EQ(altair::kNoSquare, pos.en_passant_square());
+  ASSERT_EQ(passed.hash(), pos.hash());
+
+  pos.unmake_null_move();
+  ASSERT_EQ(fen, pos.fen());
+  ASSERT_EQ(hash, pos.hash());
+}
+
+TEST(Position, is_pseudolegal_matches_movegen) {
+  // Every move generated in any of these positions is tested against every
+  // position, so that each position sees plenty of moves that don't fit it.
+  const char* fens[] = {
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R b KQkq -",
+      "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+      "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+      "rnbqkbnr/ppp1p1pp/8/3pPp2/8/8/PPPP1PPP/RNBQKBNR w KQkq f6 0 3",
+      "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+  };
+  std::vector<Move> pool;
+  for (const char* fen : fens) {
+    Position pos;
+    pos.set(fen);
+    altair::MoveList moves;
+    altair::movegen::generate_pseudolegal(pos, moves);
+    pool.insert(pool.end(), moves.begin(), moves.end());
+  }
+
+  for (const char* fen : fens) {
+    Position pos;
+    pos.set(fen);
+    altair::MoveList moves;
+    altair::movegen::generate_pseudolegal(pos, moves);
+    for (Move mov : pool) {
+      bool generated =
+          std::find(moves.begin(), moves.end(), mov) != moves.end();
+      EXPECT_EQ(generated, pos.is_pseudolegal(mov))
+          << fen << " " << mov.as_uci();
+    }
+  }
+}
+
+TEST(Position, gives_check_matches_make_move) {
+  for (const char* fen : {
+           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq -",
+           "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",
+           "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",
+           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - -",
+           // Capturing en passant uncovers the rook on a5.
+           "8/8/8/R2pP2k/8/8/8/4K3 w - d6 0 1",
+           // Castling queenside puts the rook on d1, checking the king on d8.
+           "3k4/8/8/8/8/8/8/R3K3 w Q - 0 1",
+           // Promotions, by push and by capture, checking as a knight or a
+           // queen.
+           "1n2k3/2P5/8/8/8/8/8/4K3 w - - 0 1",
+           "8/1P1k4/8/8/8/8/8/4K3 w - - 0 1",
+       }) {
+    Position pos;
+    pos.set(fen);
+    check_gives_check(pos, 3);
+  }
+}
+
+TEST(Position, may_give_quiet_check) {
+  struct Case {
+    const char* fen;
+    bool expected;
+  };
+  Case cases[] = {
+      {"4k3/8/8/8/8/8/8/4K3 w - - 0 1", false},
+      {"4k3/8/8/8/8/8/8/3NK3 w - - 0 1", false},
+      {"4k3/8/8/8/8/8/4N3/4K3 w - - 0 1", false},
+      {"4k3/8/8/8/6N1/8/8/4K3 w - - 0 1", true},
+      {"4k3/8/3P4/8/8/8/8/4K3 w - - 0 1", true},
+      {"4k3/8/8/3P4/8/8/8/4K3 w - - 0 1", false},
+      {"8/8/8/4k3/8/8/3P4/4K3 w - - 0 1", true},
+      {"4k3/8/8/8/8/3P4/8/4K3 b - - 0 1", false},
+      {"4k3/8/8/8/4N3/8/8/4R1K1 w - - 0 1", true},
+      {"4k3/8/8/8/8/8/8/R3K3 w Q - 0 1", true},
+  };
+  for (const Case& c : cases) {
+    Position pos;
+    pos.set(c.fen);
+    EXPECT_EQ(c.expected, pos.may_give_quiet_check()) << c.fen;
+  }
+}
@@ -18,59 +18,840 @@
 
 #include "search.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <optional>
+#include <sstream>
+#include <thread>
 #include <unordered_map>
 
+#include "eval.h"
 #include "movegen.h"
+#include "movepick.h"
+#include "perft.h"
+#include "thread.h"
+#include "ttable.h"
 
 namespace altair {
 
-template <bool Root>
-uint64_t perft(Position& pos, unsigned depth) {
-  if (depth == 0) {
-    return 1;
+namespace {
+
+/**
+ * The number of nodes between polls of the clock and the stop flag.
+ */
+constexpr uint64_t kPollInterval = 1024;
+
+/**
+ * Time reserved on the clock for communication overhead with the GUI.
+ */
+constexpr std::chrono::milliseconds kMoveOverhead{30};
+
+/**
+ * When the GUI doesn't tell us how many moves remain until the next time
+ * control, assume that this many do.
+ */
+constexpr unsigned kDefaultMovesToGo = 30;
+
+/**
+ * Quiescence search skips captures that, even with this margin added to the
+ * value of the captured piece, can't bring the score up to alpha.
+ */
+constexpr Value kDeltaMargin = 200;
+
+/**
+ * Helper threads skip iterations in blocks of kSkipSize[i] depths, offset by
+ * kSkipPhase[i], where i is derived from the thread's ID.
+ */
+constexpr std::array<unsigned, 20> kSkipSize = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                                3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+constexpr std::array<unsigned, 20> kSkipPhase = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3,
+                                                 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+/**
+ * Nodes shallower than this aren't worth the overhead of splitting.
+ */
+constexpr unsigned kMinSplitDepth = 4;
+
+/**
+ * Null move pruning is only tried at nodes at least this deep; shallower ones
+ * gain too little from it.
+ */
+constexpr unsigned kNullMoveMinDepth = 3;
+
+/**
+ * Null move searches are reduced by kNullMoveReduction plies, or by
+ * kNullMoveDeepReduction at nodes deeper than kNullMoveDeepDepth, where the
+ * savings are largest and the reduced search is still deep enough to be
+ * trusted. This is Heinz's adaptive null move pruning.
+ *
+ * https://www.chessprogramming.org/Null_Move_Pruning#Depth_Reduction_R
+ */
+constexpr unsigned kNullMoveReduction = 2;
+constexpr unsigned kNullMoveDeepReduction = 3;
+constexpr unsigned kNullMoveDeepDepth = 6;
+
+/**
+ * Moves are only reduced at nodes at least this deep, and never by so much
+ * that their search drops straight into quiescence search.
+ */
+constexpr unsigned kReductionMinDepth = 3;
+
+/**
+ * Late move reductions in plies, indexed by the depth of the node and the
+ * number of moves searched there so far, each capped at 63. Reductions grow
+ * with the logarithm of both.
+ */
+const std::array<std::array<uint8_t, 64>, 64> kReductions = []() {
+  std::array<std::array<uint8_t, 64>, 64> reductions{};
+  for (size_t depth = 1; depth < reductions.size(); depth++) {
+    for (size_t count = 1; count < reductions[depth].size(); count++) {
+      reductions[depth][count] = static_cast<uint8_t>(
+          0.75 + std::log(depth) * std::log(count) / 2.25);
+    }
   }
+  return reductions;
+}();
+
+/**
+ * Late move pruning: at non-PV nodes of depth d up to 3, quiet moves that
+ * don't give check are skipped once kLateMoveCounts[d] quiet moves have been
+ * searched without a cutoff. If no quiet move can give check, the picker stops
+ * producing quiet moves altogether.
+ */
+constexpr std::array<size_t, 4> kLateMoveCounts = {0, 4, 7, 12};
+
+/**
+ * Returns true if the given side has any pieces other than pawns and its king.
+ * Without them, zugzwang is common and passing the turn can't be trusted to be
+ * worse than any move.
+ */
+bool has_non_pawn_material(const Position& pos, Color side) {
+  return !(pos.pieces(side, kKnight) | pos.pieces(side, kBishop) |
+           pos.pieces(side, kRook) | pos.pieces(side, kQueen))
+              .empty();
+}
 
-  [[maybe_unused]] std::chrono::time_point<std::chrono::system_clock> start;
-  [[maybe_unused]] std::chrono::time_point<std::chrono::system_clock> end;
-  if constexpr (Root) {
-    start = std::chrono::system_clock::now();
+/**
+ * The history bonus for a quiet move that causes a cutoff at the given depth.
+ * Deeper cutoffs say more about a move, but no single one may dominate.
+ */
+int history_bonus(unsigned depth) {
+  return static_cast<int>(std::min(32 * depth * depth, 4096u));
+}
+
+}  // namespace
+
+Searcher::Searcher(Thread& thread, Position& pos, SearchLimits limits)
+    : thread_(thread),
+      pos_(pos),
+      limits_(limits),
+      split_point_(nullptr),
+      aborted_(false),
+      nodes_(thread.nodes()),
+      start_(),
+      soft_limit_(0),
+      hard_limit_(0),
+      pv_(),
+      pv_length_(),
+      stack_() {}
+
+void Searcher::search() {
+  if (limits_.perft != 0) {
+    perft::work(pos_);
+    if (thread_.is_main()) {
+      Threads::wait_for_helpers();
+      perft::report();
+    }
+    return;
+  }
+
+  start_clock();
+  thread_.heuristics().clear_killers();
+  MoveList root_moves;
+  legal_moves(root_moves, Move::null());
+  SearchResult result;
+  result.best_move = root_moves.empty() ? Move::null() : root_moves.front();
+  unsigned max_depth = kMaxPly - 1;
+  if (limits_.depth != 0) {
+    max_depth = std::min(limits_.depth, max_depth);
+  }
+
+  for (unsigned depth = 1; depth <= max_depth && !root_moves.empty();
+       depth++) {
+    if (skip_depth(depth)) {
+      continue;
+    }
+
+    Value score = search_root(-Value::infinity(), Value::infinity(), depth);
+    if (aborted_) {
+      // Keep the whole result of the last completed iteration, so that its
+      // move, score and depth agree when finish compares it with the helpers'.
+      break;
+    }
+
+    result.best_move = pv_[0][0];
+    result.pv.assign(pv_[0].begin(), pv_[0].begin() + pv_length_[0]);
+    result.score = score;
+    result.depth = depth;
+    thread_.set_result(result);
+    if (thread_.is_main()) {
+      thread_.set_nodes(nodes_);
+      report(result);
+    }
+    if (soft_limit_.count() != 0 && elapsed() >= soft_limit_) {
+      break;
+    }
   }
 
-  std::vector<Move> moves;
-  moves.reserve(224);
-  movegen::generate_pseudolegal(pos, moves);
-  uint64_t running_total = 0;
-  for (auto move : moves) {
-    pos.make_move(move);
-    if (!pos.is_check(!pos.side_to_move())) {
-      uint64_t child_nodes = perft<false>(pos, depth - 1);
-      if constexpr (Root) {
-        UCI() << move.as_uci() << ": " << child_nodes;
+  thread_.set_nodes(nodes_);
+  thread_.set_result(result);
+  if (!thread_.is_main()) {
+    return;
+  }
+
+  // The UCI protocol forbids sending bestmove during an infinite search until
+  // the GUI tells us to stop, even if we have nothing left to search.
+  while (limits_.infinite && !thread_.stop_requested()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  // The move may be a helper's, so repeat the line it came from; otherwise,
+  // the GUI would show a PV and score that don't match the move played.
+  result = finish(result);
+  thread_.set_result(result);
+  if (result.depth != 0) {
+    report(result);
+  }
+  UCI() << "bestmove " << result.best_move.as_uci();
+}
+
+Value Searcher::search_root(Value alpha, Value beta, unsigned depth) {
+  Move pv_move = pv_length_[0] != 0 ? pv_[0][0] : Move::null();
+  MoveList moves;
+  legal_moves(moves, pv_move);
+
+  Value best_score = -Value::infinity();
+  Move best_move = Move::null();
+  for (size_t i = 0; i < moves.size(); i++) {
+    Move move = moves[i];
+    make_move(move, 0, depth - 1);
+    Value score;
+    if (i == 0) {
+      score = -search<true>(-beta, -alpha, depth - 1, 1);
+    } else {
+      score = -search<false>(-alpha.next(), -alpha, depth - 1, 1);
+      if (score > alpha && score < beta) {
+        score = -search<true>(-beta, -alpha, depth - 1, 1);
       }
+    }
+    pos_.unmake_move(move);
+    if (aborted_) {
+      return best_score;
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      if (score > alpha) {
+        alpha = score;
+        best_move = move;
+        update_pv(0, move);
+      }
+    }
+  }
+
+  ttable::record_pv(pos_, best_move, depth, best_score);
+  return best_score;
+}
+
+template <bool PvNode>
+Value Searcher::search(Value alpha, Value beta, unsigned depth, unsigned ply) {
+  pv_length_[ply] = 0;
+  if (should_stop()) {
+    return Value(0);
+  }
+
+  // A position seen earlier in the game or the search is a draw: whichever
+  // side it suits can keep repeating it.
+  if (pos_.halfmove_clock() >= 100 || pos_.is_repetition()) {
+    return Value(0);
+  }
+
+  if (depth == 0 || ply >= kMaxPly - 1) {
+    return quiesce(alpha, beta, ply);
+  }
+
+  Move tt_move = Move::null();
+  auto entry = ttable::query(
+      pos_, [&](const TableEntry& entry) -> std::optional<TableEntry> {
+        if (entry.zobrist_key != pos_.hash()) {
+          return {};
+        }
+        return entry;
+      });
+  if (entry) {
+    tt_move = entry->move;
+    if (!PvNode && entry->depth >= depth) {
+      Value tt_value = entry->value.from_table(ply);
+      switch (entry->kind) {
+        case NodeKind::PV:
+          return tt_value;
+        case NodeKind::Cut:
+          if (tt_value >= beta) {
+            return tt_value;
+          }
+          break;
+        case NodeKind::All:
+          if (tt_value <= alpha) {
+            return tt_value;
+          }
+          break;
+      }
+    }
+  }
+
+  if (!tt_move.is_null() && !pos_.is_pseudolegal(tt_move)) {
+    // Only another position with the same key could have left a move that
+    // can't be played here.
+    ttable::record_collision();
+    tt_move = Move::null();
+  }
+
+  // Null move pruning: if we can pass the turn and a reduced search still
+  // fails high, a real move would almost certainly do so too. Two null moves
+  // in a row would only search the same position at a lower depth.
+  Color us = pos_.side_to_move();
+  bool in_check = pos_.is_check(us);
+  if (!PvNode && depth >= kNullMoveMinDepth &&
+      !stack_[ply - 1].move.is_null() && !beta.is_mate() && !in_check &&
+      has_non_pawn_material(pos_, us) &&
+      evaluate() >= beta) {
+    unsigned reduction = depth > kNullMoveDeepDepth ? kNullMoveDeepReduction
+                                                    : kNullMoveReduction;
+    unsigned child_depth = depth > reduction + 1 ? depth - reduction - 1 : 0;
+    stack_[ply] = StackEntry{};
+    pos_.make_null_move();
+    nodes_++;
+    Value score = -search<false>(-beta, -beta.prev(), child_depth, ply + 1);
+    pos_.unmake_null_move();
+    if (stopped()) {
+      return Value(0);
+    }
+
+    if (score >= beta) {
+      // A mate found after passing the turn isn't a mate that can be forced.
+      return score.is_mate() ? beta : score;
+    }
+  }
+
+  Heuristics& heuristics = thread_.heuristics();
+  MovePicker picker(pos_, tt_move, heuristics.killers[ply], countermove(ply),
+                    &heuristics.history,
+                    {continuation(ply, 1), continuation(ply, 2)});
+  Value best_score = -Value::infinity();
+  Move best_move = Move::null();
+  size_t move_count = 0;
+  MoveList failed_quiets;
+  std::optional<bool> may_check_quietly;
+  for (Move move = picker.next_move(); !move.is_null();
+       move = picker.next_move()) {
+    if (!pos_.is_legal(move)) {
+      continue;
+    }
 
-      running_total += child_nodes;
+    bool quiet = !move.is_capture() && !move.is_promotion();
+    if (!PvNode && !in_check && quiet && depth < kLateMoveCounts.size() &&
+        failed_quiets.size() >= kLateMoveCounts[depth] &&
+        !best_score.is_mate()) {
+      // Enough quiet moves have failed here that the rest are unlikely to do
+      // better, unless they give check: a quiet check can be mate, and a
+      // line that reached this node through a reduction has no other chance
+      // to find it.
+      if (!may_check_quietly) {
+        may_check_quietly = pos_.may_give_quiet_check();
+      }
+      if (!*may_check_quietly) {
+        picker.skip_quiets();
+        continue;
+      }
+      if (!pos_.gives_check(move)) {
+        continue;
+      }
+    }
+
+    if (move_count > 0 && depth >= kMinSplitDepth &&
+        Threads::mode() == ParallelMode::kYBWC && Threads::available()) {
+      // The picker reads the position as it generates moves, and the position
+      // changes under it once the split point is being searched, so hand the
+      // split point all of the remaining legal moves up front.
+      SplitPoint sp;
+      sp.parent = split_point_;
+      sp.depth = depth;
+      sp.ply = ply;
+      sp.pv_node = PvNode;
+      sp.in_check = in_check;
+      sp.beta = beta;
+      sp.move_count = move_count;
+      std::copy_n(stack_.begin(), ply, sp.stack.begin());
+      for (; !move.is_null(); move = picker.next_move()) {
+        if (pos_.is_legal(move)) {
+          sp.moves.push_back(move);
+        }
+      }
+      sp.alpha = alpha;
+      sp.best_score = best_score;
+      sp.best_move = best_move;
+      split(sp);
+      if (stopped()) {
+        return Value(0);
+      }
+
+      if constexpr (PvNode) {
+        if (sp.best_move != best_move) {
+          std::copy_n(sp.pv.begin(), sp.pv_length, pv_[ply].begin());
+          pv_length_[ply] = sp.pv_length;
+        }
+      }
+      best_score = sp.best_score;
+      best_move = sp.best_move;
+      break;
+    }
+
+    move_count++;
+    make_move(move, ply, depth - 1);
+    Value score;
+    if (move_count == 1) {
+      score = -search<PvNode>(-beta, -alpha, depth - 1, ply + 1);
+    } else {
+      unsigned r = reduction(PvNode, depth, ply, move_count, move, in_check);
+      score = -search<false>(-alpha.next(), -alpha, depth - 1 - r, ply + 1);
+      if (r > 0 && score > alpha) {
+        score = -search<false>(-alpha.next(), -alpha, depth - 1, ply + 1);
+      }
+      if (PvNode && score > alpha && score < beta) {
+        score = -search<true>(-beta, -alpha, depth - 1, ply + 1);
+      }
+    }
+    pos_.unmake_move(move);
+    if (stopped()) {
+      return Value(0);
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      if (score > alpha) {
+        best_move = move;
+        if constexpr (PvNode) {
+          update_pv(ply, move);
+        }
+        if (score >= beta) {
+          if (!move.is_capture() && !move.is_promotion()) {
+            update_quiet_stats(ply, depth, move, failed_quiets);
+          }
+          break;
+        }
+        alpha = score;
+      }
+    }
+
+    if (quiet) {
+      failed_quiets.push_back(move);
     }
-    pos.unmake_move(move);
   }
 
-  if constexpr (Root) {
-    end = std::chrono::system_clock::now();
-    std::chrono::duration<double> diff = end - start;
-    UCI() << "Nodes searched: " << running_total;
-    UCI() << "Elapsed time: " << diff.count();
-    UCI() << "Nodes per second: " << static_cast<uint64_t>(running_total / diff.count());
+  if (move_count == 0) {
+    return in_check ? Value::mated_in(ply) : Value(0);
   }
-  return running_total;
+
+  if (best_score >= beta) {
+    ttable::record_cut(pos_, best_move, depth, best_score.to_table(ply));
+  } else if (!best_move.is_null()) {
+    ttable::record_pv(pos_, best_move, depth, best_score.to_table(ply));
+  } else {
+    ttable::record_all(pos_, depth, best_score.to_table(ply));
+  }
+  return best_score;
 }
 
-Searcher::Searcher(Position& pos, SearchLimits limits)
-    : pos_(pos), limits_(limits) {}
+Value Searcher::quiesce(Value alpha, Value beta, unsigned ply) {
+  pv_length_[ply] = 0;
+  if (should_stop()) {
+    return Value(0);
+  }
 
-void Searcher::search() {
-  CHECK(limits_.perft != 0) << "PERFT search only right now";
-  perft<true>(pos_, limits_.perft);
+  if (ply >= kMaxPly - 1) {
+    return evaluate();
+  }
+
+  // When in check, standing pat isn't an option and every evasion must be
+  // considered, not just the captures.
+  bool in_check = pos_.is_check(pos_.side_to_move());
+  Value stand_pat = -Value::infinity();
+  if (!in_check) {
+    stand_pat = evaluate();
+    if (stand_pat >= beta) {
+      return stand_pat;
+    }
+    if (stand_pat > alpha) {
+      alpha = stand_pat;
+    }
+  }
+
+  MovePicker picker(pos_);
+  Value best_score = stand_pat;
+  size_t move_count = 0;
+  for (Move move = picker.next_move(); !move.is_null();
+       move = picker.next_move()) {
+    if (!pos_.is_legal(move)) {
+      continue;
+    }
+
+    move_count++;
+    if (!in_check && !move.is_promotion()) {
+      Piece captured = move.is_en_passant()
+                           ? make_piece(kPawn, !pos_.side_to_move())
+                           : pos_.piece_at(move.destination());
+      if (stand_pat + eval::piece_value(kind_of(captured)) + kDeltaMargin <=
+          alpha) {
+        continue;
+      }
+    }
+
+    pos_.make_move(move);
+    nodes_++;
+    Value score = -quiesce(-beta, -alpha, ply + 1);
+    pos_.unmake_move(move);
+    if (stopped()) {
+      return Value(0);
+    }
+
+    if (score > best_score) {
+      best_score = score;
+      if (score > alpha) {
+        update_pv(ply, move);
+        if (score >= beta) {
+          break;
+        }
+        alpha = score;
+      }
+    }
+  }
+
+  if (in_check && move_count == 0) {
+    return Value::mated_in(ply);
+  }
+  return best_score;
+}
+
+Value Searcher::evaluate() const {
+  Value score = eval::evaluate(pos_);
+  return pos_.side_to_move() == kWhite ? score : -score;
+}
+
+void Searcher::legal_moves(MoveList& moves, Move first) {
+  movegen::generate_legal(pos_, moves);
+
+  std::stable_partition(moves.begin(), moves.end(), [](Move move) {
+    return move.is_capture() || move.is_promotion();
+  });
+  auto it = std::find(moves.begin(), moves.end(), first);
+  if (!first.is_null() && it != moves.end()) {
+    std::rotate(moves.begin(), it, it + 1);
+  }
+}
+
+void Searcher::start_clock() {
+  start_ = Clock::now();
+  if (limits_.movetime.count() != 0) {
+    hard_limit_ = std::max(limits_.movetime - kMoveOverhead,
+                           std::chrono::milliseconds(1));
+    soft_limit_ = hard_limit_;
+    return;
+  }
+
+  Color us = pos_.side_to_move();
+  std::chrono::milliseconds time = limits_.time[us];
+  if (limits_.infinite || time.count() == 0) {
+    return;
+  }
+
+  // Budget an equal share of the remaining time for each move left in this
+  // time control, plus most of the increment. An iteration that starts after
+  // half of the budget is spent is unlikely to finish within it, so don't
+  // start one; an iteration that runs long may overshoot the budget, but
+  // never by so much as to endanger the clock.
+  unsigned moves_left =
+      limits_.movestogo != 0 ? limits_.movestogo : kDefaultMovesToGo;
+  std::chrono::milliseconds budget =
+      time / moves_left + limits_.increment[us] * 3 / 4;
+  std::chrono::milliseconds max_time =
+      std::max(time - kMoveOverhead, std::chrono::milliseconds(1));
+  soft_limit_ = std::min(budget / 2, max_time);
+  hard_limit_ = std::min(budget * 2, max_time);
+}
+
+bool Searcher::should_stop() {
+  if (!aborted_ && nodes_ % kPollInterval == 0 && check_limits()) {
+    aborted_ = true;
+  }
+  return stopped();
+}
+
+bool Searcher::check_limits() {
+  // The node limit is on the whole search, so it counts every thread's nodes,
+  // as last published by each thread here.
+  thread_.set_nodes(nodes_);
+  return thread_.stop_requested() ||
+         (limits_.nodes != 0 && Threads::nodes_searched() >= limits_.nodes) ||
+         (hard_limit_.count() != 0 && elapsed() >= hard_limit_);
+}
+
+bool Searcher::stopped() const {
+  return aborted_ ||
+         (split_point_ != nullptr && split_point_->cutoff_occurred());
+}
+
+void Searcher::split(SplitPoint& sp) {
+  // Another thread may have taken the idle threads since the caller checked
+  // for them, in which case this thread searches the split point alone.
+  Threads::assign_split_point(thread_, sp, pos_);
+
+  SplitPoint* parent = split_point_;
+  split_point_ = &sp;
+  search_split_point(sp);
+  split_point_ = parent;
+
+  // Our slaves can't see our clock or stop flag, so if we aborted, let them
+  // know by cutting off the split point. We also keep watching the clock while
+  // waiting for them, since we aren't searching any nodes of our own.
+  while (sp.slaves.load(std::memory_order_acquire) != 0) {
+    if (!aborted_ && check_limits()) {
+      aborted_ = true;
+    }
+    if (aborted_) {
+      sp.cutoff.store(true, std::memory_order_relaxed);
+    }
+    std::this_thread::yield();
+  }
+}
+
+void Searcher::search_split_point(SplitPoint& sp) {
+  unsigned ply = sp.ply;
+  unsigned depth = sp.depth;
+  while (true) {
+    Move move;
+    Value alpha;
+    size_t move_count;
+    {
+      std::lock_guard<std::mutex> lock(sp.lock);
+      if (sp.next_move == sp.moves.size() || stopped()) {
+        return;
+      }
+
+      move = sp.moves[sp.next_move++];
+      move_count = sp.move_count + sp.next_move;
+      alpha = sp.alpha;
+    }
+
+    make_move(move, ply, depth - 1);
+    unsigned r =
+        reduction(sp.pv_node, depth, ply, move_count, move, sp.in_check);
+    Value score = -search<false>(-alpha.next(), -alpha, depth - 1 - r, ply + 1);
+    if (r > 0 && score > alpha) {
+      score = -search<false>(-alpha.next(), -alpha, depth - 1, ply + 1);
+    }
+    if (sp.pv_node && score > alpha && score < sp.beta) {
+      score = -search<true>(-sp.beta, -alpha, depth - 1, ply + 1);
+    }
+    pos_.unmake_move(move);
+    if (stopped()) {
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(sp.lock);
+    if (score > sp.best_score) {
+      sp.best_score = score;
+      if (score > sp.alpha) {
+        sp.best_move = move;
+        if (sp.pv_node) {
+          sp.pv[0] = move;
+          std::copy_n(pv_[ply + 1].begin(), pv_length_[ply + 1],
+                      sp.pv.begin() + 1);
+          sp.pv_length = pv_length_[ply + 1] + 1;
+        }
+        if (score >= sp.beta) {
+          // The moves that other threads searched here aren't known, so only
+          // the move that cut off is updated.
+          if (!move.is_capture() && !move.is_promotion()) {
+            update_quiet_stats(ply, depth, move, MoveList());
+          }
+          sp.cutoff.store(true, std::memory_order_relaxed);
+          return;
+        }
+        sp.alpha = score;
+      }
+    }
+  }
+}
+
+void Searcher::help(SplitPoint& sp) {
+  std::copy_n(sp.stack.begin(), sp.ply, stack_.begin());
+  split_point_ = &sp;
+  search_split_point(sp);
+  split_point_ = nullptr;
+  thread_.set_nodes(nodes_);
+
+  // The split point lives on the splitting thread's stack and may be gone as
+  // soon as the count of slaves reaches zero, so this must be the last access.
+  sp.slaves.fetch_sub(1, std::memory_order_release);
+}
+
+bool Searcher::skip_depth(unsigned depth) const {
+  if (thread_.is_main()) {
+    return false;
+  }
+
+  size_t i = (thread_.id() - 1) % kSkipSize.size();
+  return ((depth + kSkipPhase[i]) / kSkipSize[i]) % 2 != 0;
+}
+
+SearchResult Searcher::finish(const SearchResult& main_result) {
+  Threads::stop_helpers();
+
+  // Prefer a helper's move over the main thread's if the helper searched
+  // deeper without finding a worse score, or as deep and found a better one.
+  SearchResult best = main_result;
+  for (const auto& thread : Threads::all()) {
+    const SearchResult& result = thread->result();
+    if (result.best_move.is_null() || result.depth == 0) {
+      continue;
+    }
+
+    if ((result.depth > best.depth && result.score >= best.score) ||
+        (result.depth == best.depth && result.score > best.score)) {
+      best = result;
+    }
+  }
+
+  return best;
+}
+
+std::chrono::milliseconds Searcher::elapsed() const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() -
+                                                               start_);
+}
+
+void Searcher::report(const SearchResult& result) const {
+  std::chrono::milliseconds time = elapsed();
+  uint64_t nodes = Threads::nodes_searched();
+  uint64_t nps = time.count() != 0 ? nodes * 1000 / time.count() : 0;
+  std::ostringstream pv;
+  for (Move move : result.pv) {
+    pv << ' ' << move.as_uci();
+  }
+
+  UCI() << "info depth " << result.depth << " score " << result.score.as_uci()
+        << " nodes " << nodes << " nps " << nps << " hashfull "
+        << ttable::hashfull() << " time " << time.count() << " pv" << pv.str();
+}
+
+void Searcher::update_pv(unsigned ply, Move move) {
+  pv_[ply][0] = move;
+  std::copy_n(pv_[ply + 1].begin(), pv_length_[ply + 1], pv_[ply].begin() + 1);
+  pv_length_[ply] = pv_length_[ply + 1] + 1;
+}
+
+unsigned Searcher::reduction(bool pv_node, unsigned depth, unsigned ply,
+                             size_t move_count, Move move,
+                             bool in_check) const {
+  if (depth < kReductionMinDepth || move.is_capture() || move.is_promotion() ||
+      in_check || pos_.is_check(pos_.side_to_move())) {
+    return 0;
+  }
+
+  int r = kReductions[std::min<size_t>(depth, 63)]
+                     [std::min<size_t>(move_count, 63)];
+  // The principal variation is worth searching more carefully, and so are the
+  // moves that have refuted the position's siblings.
+  if (pv_node) {
+    r--;
+  }
+  const std::array<Move, 2>& killers = thread_.heuristics().killers[ply];
+  if (move == killers[0] || move == killers[1] || move == countermove(ply)) {
+    r--;
+  }
+  return static_cast<unsigned>(std::clamp(r, 0, static_cast<int>(depth) - 2));
+}
+
+Move Searcher::countermove(unsigned ply) const {
+  if (ply == 0 || stack_[ply - 1].move.is_null()) {
+    return Move::null();
+  }
+
+  const StackEntry& previous = stack_[ply - 1];
+  return thread_.heuristics()
+      .countermoves[previous.piece][previous.move.destination()];
+}
+
+PieceToHistory* Searcher::continuation(unsigned ply, unsigned plies_back) {
+  if (ply < plies_back || stack_[ply - plies_back].move.is_null()) {
+    return nullptr;
+  }
+
+  const StackEntry& previous = stack_[ply - plies_back];
+  return &thread_.heuristics()
+              .continuation_history[previous.piece]
+                                   [previous.move.destination()];
+}
+
+void Searcher::update_quiet_stats(unsigned ply, unsigned depth, Move move,
+                                  const MoveList& failed_quiets) {
+  Heuristics& heuristics = thread_.heuristics();
+  std::array<Move, 2>& killers = heuristics.killers[ply];
+  if (killers[0] != move) {
+    killers[1] = killers[0];
+    killers[0] = move;
+  }
+
+  std::array<PieceToHistory*, 2> continuations = {continuation(ply, 1),
+                                                  continuation(ply, 2)};
+  Color us = pos_.side_to_move();
+  auto update = [&](Move quiet, int bonus) {
+    Square from = quiet.source();
+    Square to = quiet.destination();
+    update_history(heuristics.history[us][from][to], bonus);
+    Piece piece = pos_.piece_at(from);
+    for (PieceToHistory* continuation : continuations) {
+      if (continuation != nullptr) {
+        update_history((*continuation)[piece][to], bonus);
+      }
+    }
+  };
+
+  int bonus = history_bonus(depth);
+  update(move, bonus);
+  for (const ScoredMove& failed : failed_quiets) {
+    update(failed.move, -bonus);
+  }
+
+  if (ply != 0 && !stack_[ply - 1].move.is_null()) {
+    const StackEntry& previous = stack_[ply - 1];
+    heuristics.countermoves[previous.piece][previous.move.destination()] =
+        move;
+  }
+}
+
+void Searcher::make_move(Move move, unsigned ply, unsigned child_depth) {
+  // Children at depth zero drop straight into quiescence search, which doesn't
+  // use the table.
+  if (child_depth > 0) {
+    ttable::prefetch(pos_.key_after(move));
+  }
+
+  stack_[ply] = StackEntry{move, pos_.piece_at(move.source())};
+  pos_.make_move(move);
+  nodes_++;
 }
 
 }  // namespace altair
@@ -18,10 +18,29 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "move.h"
+#include "movelist.h"
+#include "movepick.h"
 #include "position.h"
+#include "value.h"
 
 namespace altair {
 
+/**
+ * The deepest ply, measured from the root, that the search will ever reach.
+ */
+constexpr unsigned kMaxPly = 128;
+
+static_assert(kMaxHistory + kMaxPly < kMaxStates,
+              "a position needs room for its history and the deepest search");
+
 /**
  * Ways to limit the search.
  */
@@ -29,18 +48,308 @@ struct SearchLimits {
   /**
    * If nonzero, this search is a perft search with the given depth.
    */
-  unsigned perft;
+  unsigned perft = 0;
+
+  /**
+   * If nonzero, the maximum depth to search to.
+   */
+  unsigned depth = 0;
+
+  /**
+   * If nonzero, the maximum number of nodes to search.
+   */
+  uint64_t nodes = 0;
+
+  /**
+   * If nonzero, search for exactly this long.
+   */
+  std::chrono::milliseconds movetime{0};
+
+  /**
+   * Time remaining on each side's clock and their increment per move; zero if
+   * the game isn't timed.
+   */
+  std::array<std::chrono::milliseconds, kColorLast> time{};
+  std::array<std::chrono::milliseconds, kColorLast> increment{};
+
+  /**
+   * If nonzero, the number of moves until the next time control.
+   */
+  unsigned movestogo = 0;
+
+  /**
+   * Search until told to stop.
+   */
+  bool infinite = false;
 };
 
+/**
+ * The outcome of a search, as far as it got.
+ */
+struct SearchResult {
+  Move best_move;
+  Value score;
+
+  /**
+   * The depth of the deepest iteration that the search completed.
+   */
+  unsigned depth = 0;
+
+  /**
+   * The line that the search expects to be played, starting with best_move.
+   */
+  std::vector<Move> pv;
+};
+
+/**
+ * The search's record of one ply of the line from the root to the node being
+ * searched.
+ */
+struct StackEntry {
+  /**
+   * The move made at this ply, and the piece that made it.
+   */
+  Move move;
+  Piece piece = kNoPiece;
+};
+
+/**
+ * A node in the search tree whose remaining moves are searched in parallel by
+ * several threads. Following the "Young Brothers Wait Concept", a node is only
+ * split after its eldest child has been searched, since that is the point at
+ * which a beta cutoff becomes unlikely.
+ *
+ * https://www.chessprogramming.org/Young_Brothers_Wait_Concept
+ */
+struct SplitPoint {
+  /**
+   * The split point that the splitting thread was itself working under, if
+   * any. A cutoff at any ancestor split point also cuts off this one.
+   */
+  SplitPoint* parent = nullptr;
+  unsigned depth = 0;
+  unsigned ply = 0;
+  bool pv_node = false;
+  bool in_check = false;
+  Value beta;
+
+  /**
+   * The number of moves that the splitting thread searched before splitting;
+   * the split point's own moves are numbered after them.
+   */
+  size_t move_count = 0;
+
+  /**
+   * The line from the root to the split point, which slaves need to look up
+   * their move ordering heuristics.
+   */
+  std::array<StackEntry, kMaxPly> stack{};
+
+  /**
+   * Guards the moves and the running result of the search at this node.
+   */
+  std::mutex lock;
+  MoveList moves;
+  size_t next_move = 0;
+  Value alpha;
+  Value best_score;
+  Move best_move;
+  std::array<Move, kMaxPly> pv{};
+  unsigned pv_length = 0;
+
+  /**
+   * The number of threads other than the splitting thread still working here.
+   */
+  std::atomic<unsigned> slaves = 0;
+
+  /**
+   * Set when this node fails high or the search is aborted; all threads
+   * working here or at any split point below stop as soon as they see it.
+   */
+  std::atomic_bool cutoff = false;
+
+  bool cutoff_occurred() const {
+    for (const SplitPoint* sp = this; sp != nullptr; sp = sp->parent) {
+      if (sp->cutoff.load(std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+class Thread;
+
 class Searcher {
  public:
-  Searcher(Position& pos, SearchLimits limits);
+  Searcher(Thread& thread, Position& pos, SearchLimits limits);
 
   void search();
 
+  /**
+   * Joins a split point as a slave, searching its moves until none remain.
+   * The position must be a copy of the position at the split point.
+   */
+  void help(SplitPoint& sp);
+
  private:
+  using Clock = std::chrono::steady_clock;
+
+  /**
+   * Searches the root position to the given depth, returning the score of the
+   * best move. The best move itself is left in pv_[0][0].
+   */
+  Value search_root(Value alpha, Value beta, unsigned depth);
+
+  /**
+   * The principal variation search; a fail-soft negamax alpha-beta search in
+   * which all moves after the first are searched with a null window and only
+   * re-searched with the full window if they unexpectedly raise alpha.
+   */
+  template <bool PvNode>
+  Value search(Value alpha, Value beta, unsigned depth, unsigned ply);
+
+  /**
+   * Quiescence search, which resolves captures and promotions at the leaves of
+   * the main search so that positions are only evaluated when they are quiet.
+   */
+  Value quiesce(Value alpha, Value beta, unsigned ply);
+
+  /**
+   * Splits the current node, sharing its remaining moves with any idle
+   * threads, and returns once every move at the split point has been searched.
+   */
+  void split(SplitPoint& sp);
+
+  /**
+   * Searches moves from the split point until none remain or a cutoff occurs.
+   */
+  void search_split_point(SplitPoint& sp);
+
+  /**
+   * Static evaluation of the current position from the side to move's point of
+   * view.
+   */
+  Value evaluate() const;
+
+  /**
+   * Produces the legal moves in the current position, with the given move (if
+   * not null) ordered first and captures before quiet moves. Used at the root,
+   * where every move is searched; other nodes use a MovePicker.
+   */
+  void legal_moves(MoveList& moves, Move first);
+
+  /**
+   * Sets up the time budget for this search from the limits.
+   */
+  void start_clock();
+
+  /**
+   * Periodically polls the stop flag and the clock, returning true if the
+   * search must be unwound as soon as possible.
+   */
+  bool should_stop();
+
+  /**
+   * Returns true if the stop flag is set or a search limit has been reached.
+   */
+  bool check_limits();
+
+  /**
+   * Returns true if the search at the current node must be unwound, either
+   * because the whole search has been aborted or because another thread
+   * produced a cutoff at a split point above this node. In either case, the
+   * scores of any nodes being unwound are meaningless.
+   */
+  bool stopped() const;
+
+  /**
+   * Helper threads skip some iterations so that, between them, threads search
+   * at a variety of depths at any given time.
+   */
+  bool skip_depth(unsigned depth) const;
+
+  /**
+   * Run by the main thread once the search is over; stops the helper threads
+   * and chooses the best move found by any thread, which the main thread then
+   * keeps as its result.
+   */
+  SearchResult finish(const SearchResult& main_result);
+
+  std::chrono::milliseconds elapsed() const;
+  void report(const SearchResult& result) const;
+  void update_pv(unsigned ply, Move move);
+
+  /**
+   * Returns the number of plies by which to reduce the search of a move that
+   * has just been made, the move_count'th searched at a node at the given ply
+   * and depth. Moves that are searched late are unlikely to be best, so quiet
+   * moves are searched less deeply the later they come, unless either side is
+   * in check.
+   */
+  unsigned reduction(bool pv_node, unsigned depth, unsigned ply,
+                     size_t move_count, Move move, bool in_check) const;
+
+  /**
+   * Returns the quiet move that last refuted the move that led to the node at
+   * the given ply, or the null move.
+   */
+  Move countermove(unsigned ply) const;
+
+  /**
+   * Returns the continuation history for moves that follow the move made the
+   * given number of plies before the node at the given ply, or null if there
+   * is no such move.
+   */
+  PieceToHistory* continuation(unsigned ply, unsigned plies_back);
+
+  /**
+   * Rewards a quiet move that caused a beta cutoff at the given ply, and
+   * penalizes the quiet moves searched before it that didn't.
+   */
+  void update_quiet_stats(unsigned ply, unsigned depth, Move move,
+                          const MoveList& failed_quiets);
+
+  /**
+   * Makes a move at the given ply, leading to a child that will be searched to
+   * the given depth, and records it on the stack. If the child will probe the
+   * transposition table, its cluster is prefetched first so that the memory
+   * access overlaps with making the move.
+   */
+  void make_move(Move move, unsigned ply, unsigned child_depth);
+
+  Thread& thread_;
   Position& pos_;
   SearchLimits limits_;
+
+  /**
+   * The innermost split point that this searcher is working under, or null.
+   */
+  SplitPoint* split_point_;
+  bool aborted_;
+  uint64_t nodes_;
+  Clock::time_point start_;
+
+  /**
+   * The search does not begin a new iteration after soft_limit_ has elapsed
+   * and aborts any iteration in progress once hard_limit_ has elapsed. Both are
+   * zero for untimed searches.
+   */
+  std::chrono::milliseconds soft_limit_;
+  std::chrono::milliseconds hard_limit_;
+
+  /**
+   * Triangular principal variation table; pv_[ply] holds the best line found
+   * from the node at that ply.
+   */
+  std::array<std::array<Move, kMaxPly>, kMaxPly> pv_;
+  std::array<unsigned, kMaxPly> pv_length_;
+
+  /**
+   * stack_[ply] records the move made at that ply on the way to the current
+   * node.
+   */
+  std::array<StackEntry, kMaxPly> stack_;
 };
 
-}  // namespace altair
\ No newline at end of file
+}  // namespace altair
@@ -0,0 +1,136 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "search.h"
+
+#include "gtest/gtest.h"
+#include "move.h"
+#include "position.h"
+#include "thread.h"
+#include "ttable.h"
+#include "value.h"
+
+using altair::Move;
+using altair::ParallelMode;
+using altair::Position;
+using altair::SearchLimits;
+using altair::SearchResult;
+using altair::Threads;
+using altair::Value;
+
+class SearchTest : public ::testing::Test {
+  void SetUp() override {
+    Threads::initialize();
+    altair::ttable::initialize(4 /* MB */, Threads::all().size());
+  }
+  void TearDown() override {
+    Threads::set_count(1);
+    Threads::set_mode(ParallelMode::kLazySMP);
+    altair::ttable::destroy();
+  }
+
+ protected:
+  SearchResult search(const Position& pos, unsigned depth) {
+    SearchLimits limits;
+    limits.depth = depth;
+    Threads::go(pos, limits);
+    Threads::wait_until_idle();
+    return Threads::all().front()->result();
+  }
+};
+
+TEST_F(SearchTest, finds_mate_in_two) {
+  Position pos;
+  pos.set("k7/8/2K5/8/8/8/8/7R w - - 0 1");
+  SearchResult result = search(pos, 6);
+  EXPECT_EQ(Value::mate_in(3), result.score);
+}
+
+TEST_F(SearchTest, lazy_smp_finds_mate_in_two) {
+  Threads::set_count(4);
+  Position pos;
+  pos.set("k7/8/2K5/8/8/8/8/7R w - - 0 1");
+  SearchResult result = search(pos, 6);
+  EXPECT_EQ(Value::mate_in(3), result.score);
+  ASSERT_FALSE(result.pv.empty());
+  EXPECT_EQ(result.best_move, result.pv.front());
+}
+
+TEST_F(SearchTest, lazy_smp_result_is_consistent) {
+  // The main thread reads every helper's result once the helpers are idle;
+  // under ThreadSanitizer, this checks that those reads are ordered after
+  // the helpers' writes.
+  Threads::set_count(4);
+  Position pos;
+  pos.set(
+      "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+  for (int i = 0; i < 3; i++) {
+    SearchResult result = search(pos, 7);
+    EXPECT_EQ(7, result.depth);
+    ASSERT_FALSE(result.pv.empty());
+    EXPECT_EQ(result.best_move, result.pv.front());
+    EXPECT_TRUE(pos.is_legal(result.best_move));
+  }
+}
+
+TEST_F(SearchTest, ybwc_finds_mate_in_two) {
+  Threads::set_mode(ParallelMode::kYBWC);
+  Threads::set_count(4);
+  Position pos;
+  pos.set("k7/8/2K5/8/8/8/8/7R w - - 0 1");
+  SearchResult result = search(pos, 6);
+  EXPECT_EQ(Value::mate_in(3), result.score);
+
+  // Helpers only search at split points.
+  uint64_t helper_nodes = 0;
+  for (size_t i = 1; i < Threads::all().size(); i++) {
+    helper_nodes += Threads::all()[i]->nodes();
+  }
+  EXPECT_NE(0, helper_nodes);
+}
+
+TEST_F(SearchTest, repetition_is_a_draw) {
+  // White is a queen and a rook down, but can give perpetual check with Qd8+
+  // Kh7 Qh4+ Kg8 Qd8+; every other line loses.
+  Position pos;
+  pos.set("7k/5pp1/8/5P2/8/8/qr4PP/3Q3K w - - 0 1");
+  SearchResult result = search(pos, 10);
+  EXPECT_EQ(Move::quiet(altair::D1, altair::D8), result.best_move);
+  EXPECT_EQ(Value(0), result.score);
+}
+
+TEST_F(SearchTest, no_null_move_without_pieces) {
+  // Black mates in six after queening. White has nothing but pawns and is in
+  // zugzwang as its king is driven into the corner, so null move searches at
+  // White's nodes would hide the mate until a deeper search.
+  Position pos;
+  pos.set("8/8/8/1P3k2/8/7p/4pP2/K7 b - - 0 1");
+  SearchResult result = search(pos, 13);
+  EXPECT_EQ(Value::mate_in(11), result.score);
+}
+
+TEST_F(SearchTest, reductions_keep_quiet_mates) {
+  // WAC.001: 1. Qg6 mates in two, but some defences are only mated by a quiet
+  // check, which late move pruning mustn't skip in lines that reductions
+  // have made shallow.
+  Position pos;
+  pos.set("2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1");
+  SearchResult result = search(pos, 6);
+  EXPECT_EQ(Move::quiet(altair::G3, altair::G6), result.best_move);
+  EXPECT_EQ(Value::mate_in(3), result.score);
+}
@@ -22,40 +22,108 @@
 #include <mutex>
 #include <thread>
 
+#include "perft.h"
 #include "search.h"
+#include "ttable.h"
 
 namespace altair {
 
+void Heuristics::clear() {
+  // The continuation history is too large to assign from a temporary on the
+  // stack, so every table is cleared in place.
+  clear_killers();
+  for (auto& by_from : history) {
+    for (auto& by_to : by_from) {
+      by_to.fill(0);
+    }
+  }
+  for (auto& by_square : countermoves) {
+    by_square.fill(Move::null());
+  }
+  for (auto& by_square : continuation_history) {
+    for (PieceToHistory& continuation : by_square) {
+      for (auto& by_to : continuation) {
+        by_to.fill(0);
+      }
+    }
+  }
+}
+
 Thread::Thread(unsigned id)
-    : id_(id), pos_(), idle_(true), stop_(false), idle_cv_(), idle_lock_() {}
+    : id_(id),
+      pos_(),
+      limits_(),
+      result_(),
+      split_point_(nullptr),
+      nodes_(0),
+      idle_(true),
+      stop_(false),
+      exit_(false),
+      exited_(false),
+      idle_cv_(),
+      idle_lock_(),
+      heuristics_() {}
 
 void Thread::start() {
   std::lock_guard<std::mutex> lock(idle_lock_);
+  stop_.store(false, std::memory_order_relaxed);
   idle_.store(false, std::memory_order_relaxed);
   idle_cv_.notify_all();
 }
 
 void Thread::stop() { stop_.store(true, std::memory_order_release); }
 
+void Thread::exit() {
+  // Threads are detached, so this is the only way to know that the thread is
+  // done with the table's registry before anything, such as the end of the
+  // program, tears it down.
+  std::unique_lock<std::mutex> lock(idle_lock_);
+  exit_.store(true, std::memory_order_relaxed);
+  idle_cv_.notify_all();
+  idle_cv_.wait(lock, [&]() { return exited_; });
+}
+
 void Thread::wait_until_idle() {
-  if (idle_.load(std::memory_order_relaxed)) {
+  // Acquiring idle_ pairs with its release in thread_loop, so that whoever
+  // waits here sees everything the thread wrote before going idle, such as its
+  // result, even if the thread never takes idle_lock_ after the wait.
+  if (idle_.load(std::memory_order_acquire)) {
     return;
   }
 
   std::unique_lock<std::mutex> lock(idle_lock_);
-  idle_cv_.wait(lock, [&]() { return idle_.load(std::memory_order_relaxed); });
+  idle_cv_.wait(lock, [&]() { return idle_.load(std::memory_order_acquire); });
 }
 
 void Thread::thread_loop() {
+  ttable::register_thread();
   while (true) {
     std::unique_lock<std::mutex> lock(idle_lock_);
-    idle_cv_.wait(lock,
-                  [&]() { return !idle_.load(std::memory_order_relaxed); });
+    idle_cv_.wait(lock, [&]() {
+      return !idle_.load(std::memory_order_relaxed) ||
+             exit_.load(std::memory_order_relaxed);
+    });
+    if (exit_.load(std::memory_order_relaxed)) {
+      ttable::unregister_thread();
+      exited_ = true;
+      idle_cv_.notify_all();
+      return;
+    }
 
-    Searcher searcher(pos_, limits_);
-    searcher.search();
+    // Searches can run indefinitely, so don't hold the lock while searching;
+    // doing so would block anyone waiting for this thread to go idle.
+    lock.unlock();
+    if (split_point_ != nullptr) {
+      Searcher searcher(*this, pos_, SearchLimits());
+      searcher.help(*split_point_);
+    } else {
+      Searcher searcher(*this, pos_, limits_);
+      searcher.search();
+    }
+    lock.lock();
+    split_point_ = nullptr;
     stop_.store(false, std::memory_order_release);
-    idle_.store(true, std::memory_order_relaxed);
+    idle_.store(true, std::memory_order_release);
     idle_cv_.notify_all();
   }
 }
@@ -63,11 +131,40 @@ void Thread::thread_loop() {
 void Thread::set_position(const Position& pos) { pos_ = pos; }
 void Thread::set_limits(const SearchLimits& limits) { limits_ = limits; }
 
+void Thread::join(SplitPoint& sp, const Position& pos) {
+  split_point_ = &sp;
+  pos_ = pos;
+  start();
+}
+
 void Threads::go(const Position& pos, const SearchLimits& limits) {
+  // Threads own their root positions while searching, so a new search can't be
+  // started until the previous one has completely finished.
+  wait_until_idle();
+  if (limits.perft != 0) {
+    perft::prepare(pos, limits.perft);
+  } else {
+    ttable::new_search();
+  }
+
   for (auto& thread : threads_) {
     thread->set_position(pos);
     thread->set_limits(limits);
-    thread->start();
+    thread->set_nodes(0);
+    thread->set_result(SearchResult());
+  }
+
+  // With YBWC, helpers are woken as needed by the main thread's search. Perft
+  // always runs on every thread, though.
+  if (mode_ == ParallelMode::kYBWC && limits.perft == 0) {
+    threads_.front()->start();
+    return;
+  }
+
+  // The main thread stops the helpers when it finishes, so it must be started
+  // last; otherwise it could try to stop a helper that hasn't started yet.
+  for (auto it = threads_.rbegin(); it != threads_.rend(); it++) {
+    (*it)->start();
   }
 }
 
@@ -83,17 +180,87 @@ void Threads::wait_until_idle() {
   }
 }
 
-void Threads::initialize() {
-  std::call_once(init_flag_, []() {
-    threads_.emplace_back(std::make_shared<Thread>(0));
-    for (auto& thread : threads_) {
-      std::thread tr([=]() { thread->thread_loop(); });
-      tr.detach();
+void Threads::stop_helpers() {
+  for (size_t i = 1; i < threads_.size(); i++) {
+    threads_[i]->stop();
+  }
+  wait_for_helpers();
+}
+
+void Threads::wait_for_helpers() {
+  for (size_t i = 1; i < threads_.size(); i++) {
+    threads_[i]->wait_until_idle();
+  }
+}
+
+uint64_t Threads::nodes_searched() {
+  uint64_t nodes = 0;
+  for (auto& thread : threads_) {
+    nodes += thread->nodes();
+  }
+  return nodes;
+}
+
+void Threads::clear() {
+  wait_until_idle();
+  for (auto& thread : threads_) {
+    thread->heuristics().clear();
+  }
+}
+
+void Threads::set_mode(ParallelMode mode) {
+  wait_until_idle();
+  mode_ = mode;
+}
+
+bool Threads::available() {
+  for (size_t i = 1; i < threads_.size(); i++) {
+    if (threads_[i]->is_available()) {
+      return true;
     }
-  });
+  }
+  return false;
+}
+
+unsigned Threads::assign_split_point(Thread& master, SplitPoint& sp,
+                                     const Position& pos) {
+  std::lock_guard<std::mutex> lock(split_lock_);
+  unsigned count = 0;
+  for (auto& thread : threads_) {
+    if (thread.get() == &master || !thread->is_available()) {
+      continue;
+    }
+
+    sp.slaves.fetch_add(1, std::memory_order_relaxed);
+    thread->join(sp, pos);
+    count++;
+  }
+  return count;
+}
+
+void Threads::initialize() {
+  std::call_once(init_flag_, []() { set_count(1); });
+}
+
+void Threads::set_count(unsigned count) {
+  wait_until_idle();
+  while (threads_.size() > count) {
+    // The thread's own reference keeps it alive until it leaves its loop.
+    threads_.back()->exit();
+    threads_.pop_back();
+  }
+
+  while (threads_.size() < count) {
+    auto thread = std::make_shared<Thread>(threads_.size());
+    std::thread tr([=]() { thread->thread_loop(); });
+    tr.detach();
+    threads_.push_back(std::move(thread));
+  }
 }
 
 std::once_flag Threads::init_flag_;
 std::vector<std::shared_ptr<Thread>> Threads::threads_;
+ParallelMode Threads::mode_ = ParallelMode::kLazySMP;
+std::mutex Threads::split_lock_;
 
 }  // namespace altair
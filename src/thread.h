@@ -18,15 +18,63 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <mutex>
+#include <vector>
 
+#include "compiler.h"
+#include "move.h"
+#include "movepick.h"
 #include "position.h"
 #include "search.h"
 
 namespace altair {
 
+/**
+ * Strategies for searching with more than one thread.
+ */
+enum class ParallelMode {
+  /**
+   * All threads search the root position independently, sharing results only
+   * through the transposition table.
+   */
+  kLazySMP,
+
+  /**
+   * Only the main thread searches the root position; idle threads join split
+   * points created by busy threads once the eldest child of a node has been
+   * searched.
+   */
+  kYBWC,
+};
+
+/**
+ * What a thread has learned about move ordering from the cutoffs it has seen.
+ * Each thread keeps its own tables, written without synchronization; they are
+ * aligned so that no two threads' tables share a cache line.
+ */
+struct alignas(kCacheLineSize) Heuristics {
+  /**
+   * The two most recent quiet moves to cause a cutoff at each ply, the most
+   * recent first.
+   */
+  std::array<std::array<Move, 2>, kMaxPly> killers{};
+  ButterflyHistory history{};
+  CounterMoveHistory countermoves{};
+  ContinuationHistory continuation_history{};
+
+  /**
+   * Forgets the killers, which only make sense for the position they were
+   * found in. The other tables carry over between searches.
+   */
+  void clear_killers() { killers = {}; }
+
+  void clear();
+};
+
 /**
  * A worker thread, to which Altair delegates search work.
  */
@@ -39,12 +87,53 @@ class Thread {
 
   void start();
   void stop();
+
+  /**
+   * Tells this idle thread to leave its loop, blocking until it no longer
+   * touches any state shared with other threads. The thread itself may
+   * still be running when this returns.
+   */
+  void exit();
   void wait_until_idle();
   void thread_loop();
   void set_position(const Position& pos);
   void set_limits(const SearchLimits& pos);
 
+  /**
+   * Wakes this idle thread to work at the given split point, starting from a
+   * copy of the given position.
+   */
+  void join(SplitPoint& sp, const Position& pos);
+
+  /**
+   * Returns true if this thread is idle and can be assigned to a split point.
+   */
+  bool is_available() const { return idle_.load(std::memory_order_acquire); }
+
   unsigned id() const { return id_; }
+  bool is_main() const { return id_ == 0; }
+  bool stop_requested() const { return stop_.load(std::memory_order_relaxed); }
+
+  /**
+   * The number of nodes searched by this thread in the current search. Only
+   * the thread itself writes to this; other threads may read it at any time.
+   */
+  uint64_t nodes() const { return nodes_.load(std::memory_order_relaxed); }
+  void set_nodes(uint64_t nodes) {
+    nodes_.store(nodes, std::memory_order_relaxed);
+  }
+
+  /**
+   * The result of the deepest iteration that this thread has completed. Only
+   * safe to read from other threads once this thread is idle.
+   */
+  const SearchResult& result() const { return result_; }
+  void set_result(const SearchResult& result) { result_ = result; }
+
+  /**
+   * Move ordering tables; only to be used by this thread's own searcher.
+   */
+  Heuristics& heuristics() { return heuristics_; }
 
  private:
   /**
@@ -53,15 +142,40 @@ class Thread {
   unsigned id_;
   Position pos_;
   SearchLimits limits_;
+  SearchResult result_;
+  SplitPoint* split_point_;
+  std::atomic<uint64_t> nodes_;
   std::atomic_bool idle_;
   std::atomic_bool stop_;
+  std::atomic_bool exit_;
+
+  /**
+   * Set by the thread, under idle_lock_, once it has left its loop.
+   */
+  bool exited_;
   std::condition_variable idle_cv_;
   std::mutex idle_lock_;
+  Heuristics heuristics_;
 };
 
 /**
  * UCI-facing interface for thread management; encapsulates all creation,
  * destruction, suspension, and management of threads of execution.
+ *
+ * Searches are parallelized in one of two ways, chosen by the UCI
+ * "ParallelSearch" option through set_mode:
+ *
+ *  - With lazy SMP, the default, every thread searches the root position
+ *    independently and threads communicate only through the shared
+ *    transposition table.
+ *  - With YBWC, only the main thread searches the root. A busy thread that
+ *    has searched the eldest child of a node shares the node's remaining
+ *    moves with idle threads through a split point, taking split_lock_ to
+ *    claim them. The threads at a split point share its bounds, best move
+ *    and cutoff flag, as well as the table.
+ *
+ * In either mode, the thread with ID zero is the main thread, which is
+ * responsible for time management and reporting the search's results.
  */
 class Threads {
  public:
@@ -80,14 +194,75 @@ class Threads {
    */
   static void wait_until_idle();
 
+  /**
+   * Stop all threads other than the main thread and block until they are idle.
+   * Called by the main thread when it has finished searching.
+   */
+  static void stop_helpers();
+
+  /**
+   * Block until all threads other than the main thread are idle.
+   */
+  static void wait_for_helpers();
+
+  /**
+   * The total number of nodes searched by all threads in the current search.
+   */
+  static uint64_t nodes_searched();
+
+  /**
+   * Clears every thread's move ordering tables, waiting for any search in
+   * progress to complete first. Called when a new game starts.
+   */
+  static void clear();
+
+  static ParallelMode mode() { return mode_; }
+
+  /**
+   * Sets the parallel search strategy, waiting for any search in progress to
+   * complete first.
+   */
+  static void set_mode(ParallelMode mode);
+
+  /**
+   * Returns true if any thread is idle and could join a split point. Only a
+   * hint; the thread may be taken by the time the caller tries to split.
+   */
+  static bool available();
+
+  /**
+   * Assigns idle threads to the given split point, created by the given master
+   * thread at the given position. Returns the number of threads assigned.
+   */
+  static unsigned assign_split_point(Thread& master, SplitPoint& sp,
+                                     const Position& pos);
+
+  /**
+   * All threads in the pool, the main thread first.
+   */
+  static const std::vector<std::shared_ptr<Thread>>& all() { return threads_; }
+
   /**
    * Initialize the global thread pool.
    */
   static void initialize();
 
+  /**
+   * Resize the thread pool to contain exactly the given number of threads,
+   * waiting for any search in progress to complete first.
+   */
+  static void set_count(unsigned count);
+
  private:
   static std::once_flag init_flag_;
   static std::vector<std::shared_ptr<Thread>> threads_;
+  static ParallelMode mode_;
+
+  /**
+   * Serializes the assignment of threads to split points, so that two masters
+   * can't claim the same idle thread.
+   */
+  static std::mutex split_lock_;
 };
 
 };  // namespace altair
\ No newline at end of file
@@ -18,75 +18,548 @@
 
 #include "ttable.h"
 
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <memory>
+#include <mutex>
 #include <new>
+#include <stdexcept>
 #include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace altair::ttable {
 
-std::atomic<RawTableEntry*> kTable;
-std::atomic<size_t> kTableSize;
+Cluster* kTable = nullptr;
+size_t kTableSize = 0;
+
+namespace {
+
+/**
+ * The generation of the current search, of which only the value modulo
+ * kGenerationCount is used. A shared table keeps its generation in its header,
+ * so that every process attached to it ages entries alike; otherwise, it's
+ * kept here.
+ */
+uint8_t local_generation = 0;
+uint8_t* generation_slot = &local_generation;
+
+std::atomic_ref<uint8_t> generation() {
+  return std::atomic_ref<uint8_t>(*generation_slot);
+}
+
+uint8_t current_generation() {
+  return generation().load(std::memory_order_relaxed) & (kGenerationCount - 1);
+}
+
+/**
+ * A table loaded from a file or placed in shared memory is a mapping rather
+ * than an allocation, and is released differently. The mapping includes a
+ * header, so the table starts partway into it.
+ */
+void* mapping = nullptr;
+size_t mapping_size = 0;
+bool shared_mapping = false;
+
+/**
+ * Tables saved to disk start with this header, padded to the size of a cluster
+ * so that the clusters that follow it stay aligned when the file is mapped.
+ */
+struct FileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t cluster_size;
+  uint64_t cluster_count;
+  uint8_t generation;
+};
+
+/**
+ * "ALTAIRTT", read as a little-endian integer. In a shared table, the magic is
+ * also the flag that the creator has finished writing the header.
+ */
+constexpr uint64_t kFileMagic = 0x5454524941544c41;
+constexpr uint32_t kFileVersion = 1;
+constexpr size_t kFileHeaderSize = sizeof(Cluster);
+static_assert(sizeof(FileHeader) <= kFileHeaderSize);
+
+FileHeader make_header(uint64_t cluster_count) {
+  FileHeader header{};
+  header.magic = kFileMagic;
+  header.version = kFileVersion;
+  header.cluster_size = sizeof(Cluster);
+  header.cluster_count = cluster_count;
+  header.generation = current_generation();
+  return header;
+}
+
+/**
+ * Checks that a header describes a table that this build can use, given the
+ * size of the file it came from.
+ */
+void validate(const FileHeader& header, uint64_t file_size) {
+  if (header.magic != kFileMagic || header.version != kFileVersion ||
+      header.cluster_size != sizeof(Cluster)) {
+    throw std::runtime_error("not a transposition table file");
+  }
+
+  if (header.cluster_count == 0 ||
+      file_size != kFileHeaderSize + header.cluster_count * sizeof(Cluster)) {
+    throw std::runtime_error("transposition table file is truncated");
+  }
+}
+
+/**
+ * How valuable it is to keep an entry: deep searches are worth more than
+ * shallow ones, but each search since the entry was stored costs it some of
+ * its worth, since older entries are less likely to be reached again.
+ */
+int worth(const TableEntry& entry, uint8_t current) {
+  unsigned age = (current - entry.generation) & (kGenerationCount - 1);
+  return static_cast<int>(entry.depth) - 8 * static_cast<int>(age);
+}
+
+/**
+ * Chooses the entry in which to store the position with the given key: the
+ * position's existing entry if it has one, otherwise an empty entry, otherwise
+ * the entry that is least worth keeping. Also returns what the chosen entry
+ * currently holds.
+ */
+PackedEntry& replacement(uint64_t key, TableEntry& existing) {
+  uint8_t current = current_generation();
+  PackedEntry* victim = nullptr;
+  for (PackedEntry& entry : cluster(key).entries) {
+    TableEntry contents = entry.load();
+    if (contents.depth == 0 || contents.zobrist_key == key) {
+      existing = contents;
+      return entry;
+    }
+
+    if (victim == nullptr ||
+        worth(contents, current) < worth(existing, current)) {
+      victim = &entry;
+      existing = contents;
+    }
+  }
+
+  return *victim;
+}
+
+void count_store(uint64_t key, const TableEntry& existing) {
+  count(counters.stores);
+  if (existing.depth != 0 && existing.zobrist_key != key) {
+    count(counters.overwrites);
+  }
+}
+
+void store(TableEntry entry) {
+  TableEntry existing;
+  entry.generation = current_generation();
+  PackedEntry& packed = replacement(entry.zobrist_key, existing);
+  count_store(entry.zobrist_key, existing);
+  packed.store(entry);
+}
+
+/**
+ * The counters of every registered thread, and the totals of those that have
+ * since unregistered.
+ */
+std::mutex registry_lock;
+std::vector<Counters*> registry;
+Stats retired;
+
+void accumulate(Stats& stats, const Counters& thread) {
+  stats.probes += thread.probes.load(std::memory_order_relaxed);
+  stats.hits += thread.hits.load(std::memory_order_relaxed);
+  stats.stores += thread.stores.load(std::memory_order_relaxed);
+  stats.overwrites += thread.overwrites.load(std::memory_order_relaxed);
+  stats.collisions += thread.collisions.load(std::memory_order_relaxed);
+}
+
+void reset(Counters& thread) {
+  for (auto* counter : {&thread.probes, &thread.hits, &thread.stores,
+                        &thread.overwrites, &thread.collisions}) {
+    counter->store(0, std::memory_order_relaxed);
+  }
+}
+
+/**
+ * Tables at least this large are aligned to, and rounded up to, this size,
+ * which is the size of a huge page on x86-64 Linux.
+ */
+constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+/**
+ * Allocates uninitialized memory for the table. Large tables are backed by
+ * huge pages where the OS supports it, since with 4 KiB pages nearly every
+ * probe of a large table misses the TLB. If huge pages aren't available, the
+ * table is backed by normal pages.
+ *
+ * @throws std::bad_alloc if the memory can't be allocated.
+ */
+Cluster* allocate(size_t bytes) {
+  size_t alignment = alignof(Cluster);
+  if (bytes >= kHugePageSize) {
+    alignment = kHugePageSize;
+    bytes = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+  }
+
+#if defined(_MSC_VER)
+  void* memory = _aligned_malloc(bytes, alignment);
+#else
+  void* memory = std::aligned_alloc(alignment, bytes);
+#endif
+  if (memory == nullptr) {
+    throw std::bad_alloc();
+  }
 
-void initialize(uint64_t hashSize) {
-  size_t entry_count = (hashSize * 1024 * 1024) / sizeof(RawTableEntry);
-  RawTableEntry* table = new RawTableEntry[entry_count];
-  kTable.store(table, std::memory_order_relaxed);
-  kTableSize.store(entry_count, std::memory_order_relaxed);
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  // Only a hint; this fails harmlessly if transparent huge pages are disabled.
+  madvise(memory, bytes, MADV_HUGEPAGE);
+#endif
+  return static_cast<Cluster*>(memory);
+}
+
+void deallocate(Cluster* table) {
+#if defined(_MSC_VER)
+  _aligned_free(table);
+#else
+  std::free(table);
+#endif
+}
+
+}  // namespace
+
+void initialize(uint64_t hashSize, size_t threads) {
+  // The current table is only released once its replacement is allocated, so
+  // that it is still there to search with if the allocation fails.
+  size_t cluster_count = (hashSize * 1024 * 1024) / sizeof(Cluster);
+  Cluster* table = allocate(cluster_count * sizeof(Cluster));
+  destroy();
+  kTable = table;
+  kTableSize = cluster_count;
+  clear(threads);
 }
 
 void destroy() {
-  delete[] kTable.load(std::memory_order_relaxed);
-  kTable.store(nullptr, std::memory_order_relaxed);
-  kTableSize.store(0, std::memory_order_relaxed);
+#if defined(__unix__) || defined(__APPLE__)
+  if (mapping != nullptr) {
+    if (shared_mapping) {
+      local_generation = generation().load(std::memory_order_relaxed);
+      generation_slot = &local_generation;
+    }
+    munmap(mapping, mapping_size);
+    mapping = nullptr;
+    mapping_size = 0;
+    shared_mapping = false;
+    kTable = nullptr;
+  }
+#endif
+
+  deallocate(kTable);
+  kTable = nullptr;
+  kTableSize = 0;
+}
+
+void initialize_shared(const std::string& name, uint64_t hashSize) {
+#if defined(__unix__) || defined(__APPLE__)
+  // Entries are only consistent across processes if their atomics are
+  // implemented by the hardware rather than by a lock private to each process.
+  static_assert(std::atomic<uint64_t>::is_always_lock_free);
+  static_assert(std::atomic_ref<uint64_t>::is_always_lock_free);
+  static_assert(std::atomic_ref<uint8_t>::is_always_lock_free);
+
+  // Whichever process creates the segment sizes it and writes its header;
+  // shm segments start zeroed, which is an empty table. Processes attaching
+  // to an existing segment may briefly have to wait for its creator, first
+  // to size it and then to publish its header by storing the magic.
+  constexpr int kMaxAttempts = 100;
+  int attempts = 0;
+  size_t cluster_count = (hashSize * 1024 * 1024) / sizeof(Cluster);
+  size_t size = kFileHeaderSize + cluster_count * sizeof(Cluster);
+  bool created = true;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0 && errno == EEXIST) {
+    created = false;
+    fd = shm_open(name.c_str(), O_RDWR, 0600);
+  }
+  if (fd < 0) {
+    throw std::runtime_error("failed to open shared memory " + name);
+  }
+
+  if (created && ftruncate(fd, size) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("failed to size shared memory " + name);
+  }
+
+  struct stat info;
+  while (!created) {
+    if (fstat(fd, &info) != 0 || attempts == kMaxAttempts) {
+      close(fd);
+      throw std::runtime_error("shared memory " + name + " is not a table");
+    }
+    if (info.st_size > static_cast<off_t>(kFileHeaderSize)) {
+      size = info.st_size;
+      break;
+    }
+    attempts++;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  void* memory =
+      mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error("failed to map shared memory " + name);
+  }
+
+  auto* header = static_cast<FileHeader*>(memory);
+  std::atomic_ref<uint64_t> magic(header->magic);
+  if (created) {
+    // Attachers read the magic concurrently, so the rest of the header is
+    // written around it and the magic is stored last.
+    FileHeader fresh = make_header(cluster_count);
+    header->version = fresh.version;
+    header->cluster_size = fresh.cluster_size;
+    header->cluster_count = fresh.cluster_count;
+    header->generation = fresh.generation;
+    magic.store(fresh.magic, std::memory_order_release);
+  } else {
+    while (magic.load(std::memory_order_acquire) != kFileMagic) {
+      if (attempts == kMaxAttempts) {
+        munmap(memory, size);
+        throw std::runtime_error("shared memory " + name + " is not a table");
+      }
+      attempts++;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // Once the magic is seen, the creator never writes the header again.
+    try {
+      validate(*header, size);
+    } catch (...) {
+      munmap(memory, size);
+      throw;
+    }
+  }
+
+  destroy();
+  mapping = memory;
+  mapping_size = size;
+  shared_mapping = true;
+  kTable = reinterpret_cast<Cluster*>(static_cast<char*>(memory) +
+                                      kFileHeaderSize);
+  kTableSize = header->cluster_count;
+  generation_slot = &header->generation;
+#else
+  (void)name;
+  (void)hashSize;
+  throw std::runtime_error("shared memory tables are not supported here");
+#endif
+}
+
+bool shared() { return shared_mapping; }
+
+void save(const std::string& path) {
+  FileHeader header = make_header(kTableSize);
+  char header_bytes[kFileHeaderSize] = {};
+  std::memcpy(header_bytes, &header, sizeof(header));
+
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(header_bytes, kFileHeaderSize);
+  file.write(reinterpret_cast<const char*>(kTable),
+             kTableSize * sizeof(Cluster));
+  file.close();
+  if (!file) {
+    throw std::runtime_error("failed to write " + path);
+  }
+}
+
+void load(const std::string& path) {
+#if defined(__unix__) || defined(__APPLE__)
+  // The file is mapped privately: pages are read in as the search first
+  // touches them, and writes to the table never reach the file.
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  struct stat info;
+  FileHeader header;
+  if (fstat(fd, &info) != 0 ||
+      pread(fd, &header, sizeof(header), 0) != sizeof(header)) {
+    close(fd);
+    throw std::runtime_error("failed to read " + path);
+  }
+
+  try {
+    validate(header, info.st_size);
+  } catch (...) {
+    close(fd);
+    throw;
+  }
+
+  void* memory = mmap(nullptr, info.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (memory == MAP_FAILED) {
+    throw std::runtime_error("failed to map " + path);
+  }
+
+  destroy();
+  mapping = memory;
+  mapping_size = info.st_size;
+  kTable = reinterpret_cast<Cluster*>(static_cast<char*>(memory) +
+                                      kFileHeaderSize);
+#else
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file) {
+    throw std::runtime_error("failed to open " + path);
+  }
+
+  uint64_t file_size = file.tellg();
+  FileHeader header;
+  file.seekg(0);
+  file.read(reinterpret_cast<char*>(&header), sizeof(header));
+  validate(header, file_size);
+
+  Cluster* table = allocate(header.cluster_count * sizeof(Cluster));
+  file.seekg(kFileHeaderSize);
+  file.read(reinterpret_cast<char*>(table),
+            header.cluster_count * sizeof(Cluster));
+  if (!file) {
+    deallocate(table);
+    throw std::runtime_error("failed to read " + path);
+  }
+
+  destroy();
+  kTable = table;
+#endif
+
+  kTableSize = header.cluster_count;
+  generation().store(header.generation, std::memory_order_relaxed);
+}
+
+void clear(size_t threads) {
+  Cluster* table = kTable;
+  size_t cluster_count = kTableSize;
+  threads = std::max<size_t>(threads, 1);
+
+  // Each thread constructs an equal share of the table. On NUMA machines this
+  // also spreads the table's pages across the threads' nodes.
+  std::vector<std::thread> workers;
+  size_t stride = (cluster_count + threads - 1) / threads;
+  for (size_t i = 0; i < threads; i++) {
+    size_t begin = std::min(i * stride, cluster_count);
+    size_t end = std::min(begin + stride, cluster_count);
+    workers.emplace_back([=]() {
+      std::uninitialized_value_construct(table + begin, table + end);
+    });
+  }
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+void register_thread() {
+  std::lock_guard<std::mutex> guard(registry_lock);
+  registry.push_back(&counters);
+}
+
+void unregister_thread() {
+  std::lock_guard<std::mutex> guard(registry_lock);
+  accumulate(retired, counters);
+  std::erase(registry, &counters);
+}
+
+Stats stats() {
+  Stats result;
+  {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    result = retired;
+    for (const Counters* thread : registry) {
+      accumulate(result, *thread);
+    }
+  }
+
+  uint8_t current = current_generation();
+  for (size_t i = 0; i < kTableSize; i++) {
+    for (const PackedEntry& packed : kTable[i].entries) {
+      TableEntry entry = packed.load();
+      if (entry.depth != 0) {
+        result.entries++;
+        result.depths[entry.depth]++;
+        result.ages[(current - entry.generation) & (kGenerationCount - 1)]++;
+      }
+    }
+  }
+  return result;
+}
+
+unsigned hashfull() {
+  uint8_t current = current_generation();
+  size_t sample = std::min<size_t>(kTableSize, 1000);
+  size_t used = 0;
+  for (size_t i = 0; i < sample; i++) {
+    for (const PackedEntry& packed : kTable[i].entries) {
+      TableEntry entry = packed.load();
+      used += entry.depth != 0 && entry.generation == current;
+    }
+  }
+  return sample != 0 ? used * 1000 / (sample * Cluster::kEntryCount) : 0;
+}
+
+void new_search() {
+  // Counters are reported per search. Every thread is idle here, so none of
+  // them are being written.
+  {
+    std::lock_guard<std::mutex> guard(registry_lock);
+    retired = Stats();
+    for (Counters* thread : registry) {
+      reset(*thread);
+    }
+  }
+
+  // Other processes sharing the table may be advancing it at the same time.
+  generation().fetch_add(1, std::memory_order_relaxed);
 }
 
 void record_pv(const Position& pos, Move best, unsigned depth, Value value) {
-  uint64_t key = pos.hash();
-  RawTableEntry& entry =
-      kTable.load(std::memory_order_relaxed)[key % kTableSize];
-  entry.with_lock([&](TableEntry& entry) {
-    std::memset(&entry, 0, sizeof(TableEntry));
-    entry.zobrist_key = key;
-    entry.move = best;
-    entry.value = value;
-    entry.depth = depth;
-    entry.kind = NodeKind::PV;
-    return 0;
-  });
+  store(TableEntry{pos.hash(), best, value, static_cast<uint8_t>(depth),
+                   NodeKind::PV});
 }
 
 void record_cut(const Position& pos, Move best, unsigned depth, Value value) {
-  uint64_t key = pos.hash();
-  RawTableEntry& entry =
-      kTable.load(std::memory_order_relaxed)[key % kTableSize];
-  entry.with_lock([&](TableEntry& entry) {
-    entry.zobrist_key = key;
-    entry.move = best;
-    entry.value = value;
-    entry.depth = depth;
-    entry.kind = NodeKind::Cut;
-    return 0;
-  });
+  store(TableEntry{pos.hash(), best, value, static_cast<uint8_t>(depth),
+                   NodeKind::Cut});
 }
 
 void record_all(const Position& pos, unsigned depth, Value value) {
   uint64_t key = pos.hash();
-  RawTableEntry& entry =
-      kTable.load(std::memory_order_relaxed)[key % kTableSize];
-  entry.with_lock([&](TableEntry& entry) {
-    if (entry.kind == NodeKind::All && entry.depth >= depth) {
-      return 0;
-    }
+  TableEntry existing;
+  PackedEntry& entry = replacement(key, existing);
+  if (existing.zobrist_key == key && existing.kind == NodeKind::All &&
+      existing.depth >= depth) {
+    return;
+  }
+
+  count_store(key, existing);
 
-    entry.zobrist_key = key;
-    entry.move = Move::null();
-    entry.depth = depth;
-    entry.kind = NodeKind::All;
-    return 0;
-  });
+  entry.store(TableEntry{key, Move::null(), value, static_cast<uint8_t>(depth),
+                         NodeKind::All,
+                         current_generation()});
 }
 
-}  // namespace altair::ttable
\ No newline at end of file
+}  // namespace altair::ttable
@@ -24,9 +24,13 @@
  * https://www.chessprogramming.org/Transposition_Table
  */
 
+#include <array>
 #include <atomic>
+#include <bit>
 #include <cstdint>
+#include <string>
 
+#include "compiler.h"
 #include "move.h"
 #include "position.h"
 #include "value.h"
@@ -35,53 +39,237 @@ namespace altair {
 
 enum class NodeKind : uint8_t { PV, All, Cut };
 
+/**
+ * A transposition table entry, as presented to callers of ttable::query. If no
+ * entry exists for the queried position, zobrist_key won't match its hash.
+ */
 struct TableEntry {
   uint64_t zobrist_key;
   Move move;
   Value value;
   uint8_t depth;
   NodeKind kind;
+
+  /**
+   * The generation of the search that stored this entry, modulo
+   * kGenerationCount.
+   */
+  uint8_t generation;
 };
 
-#ifdef __cpp_lib_hardware_interference_size
-using std::hardware_destructive_interference_size;
-#else
-constexpr size_t hardware_destructive_interference_size = 64;
-#endif
+/**
+ * Entries record the generation they were stored in using this many distinct
+ * values, after which generations wrap around.
+ */
+constexpr unsigned kGenerationCount = 64;
 
-class alignas(hardware_destructive_interference_size) RawTableEntry {
+/**
+ * A transposition table entry as it is stored in the table. The contents of the
+ * entry are packed into a single word, and the key is stored XOR'd with it, so
+ * that entries can be read and written by many threads without any locking: an
+ * entry torn by concurrent writes fails to match any key when read back.
+ *
+ * https://www.chessprogramming.org/Shared_Hash_Table#Lockless
+ */
+class PackedEntry {
  public:
-  RawTableEntry() : lock(0), entry() {}
+  PackedEntry() : check_(0), data_(0) {}
+
+  /**
+   * Reads the entry. The key of the returned entry is only meaningful if the
+   * entry wasn't torn; entries with a depth of zero are empty, since the search
+   * never records a position at depth zero.
+   */
+  TableEntry load() const {
+    uint64_t data = data_.load(std::memory_order_relaxed);
+    uint64_t check = check_.load(std::memory_order_relaxed);
+    return TableEntry{
+        check ^ data,
+        std::bit_cast<Move>(static_cast<uint16_t>(data)),
+        std::bit_cast<Value>(static_cast<uint16_t>(data >> 16)),
+        static_cast<uint8_t>(data >> 32),
+        static_cast<NodeKind>((data >> 40) & 0x3),
+        static_cast<uint8_t>((data >> 42) & (kGenerationCount - 1)),
+    };
+  }
+
+  void store(const TableEntry& entry) {
+    uint64_t data =
+        static_cast<uint64_t>(std::bit_cast<uint16_t>(entry.move)) |
+        static_cast<uint64_t>(std::bit_cast<uint16_t>(entry.value)) << 16 |
+        static_cast<uint64_t>(entry.depth) << 32 |
+        static_cast<uint64_t>(entry.kind) << 40 |
+        static_cast<uint64_t>(entry.generation) << 42;
+    data_.store(data, std::memory_order_relaxed);
+    check_.store(entry.zobrist_key ^ data, std::memory_order_relaxed);
+  }
 
  private:
-  std::atomic<uint8_t> lock;
-  mutable TableEntry entry;
+  std::atomic<uint64_t> check_;
+  std::atomic<uint64_t> data_;
+};
 
- public:
-  template <typename F>
-  auto with_lock(F func) -> decltype(func(entry)) {
-    uint8_t expected = 0;
-    while (!lock.compare_exchange_weak(expected, 1, std::memory_order_acquire,
-                                       std::memory_order_relaxed)) {
-      expected = 0;
-    }
+/**
+ * A bucket of entries sharing one cache line. A position may be stored in any
+ * entry of the cluster that its key maps to.
+ */
+struct alignas(kCacheLineSize) Cluster {
+  static constexpr size_t kEntryCount = 4;
 
-    auto result = func(entry);
-    lock.store(0, std::memory_order_release);
-    return result;
-  }
+  std::array<PackedEntry, kEntryCount> entries;
 };
 
-static_assert(sizeof(RawTableEntry) == 64,
-              "RawTableEntry should occupy one cache line");
+static_assert(sizeof(Cluster) == 64, "Cluster should occupy one cache line");
 
 namespace ttable {
 
-extern std::atomic<RawTableEntry*> kTable;
-extern std::atomic<size_t> kTableSize;
+/**
+ * The table and its size in clusters. These only change while no search is
+ * running, so they're read without synchronization.
+ */
+extern Cluster* kTable;
+extern size_t kTableSize;
+
+/**
+ * Counts of the table operations performed by one thread. Each thread only
+ * writes its own counters, so they're bumped without read-modify-write
+ * instructions; the atomics only make it safe to read them from elsewhere.
+ */
+struct Counters {
+  std::atomic<uint64_t> probes;
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> stores;
+
+  /**
+   * Stores that evicted an entry for a different position.
+   */
+  std::atomic<uint64_t> overwrites;
+
+  /**
+   * Hits whose move turned out not to be legal in the probed position, which
+   * can only happen if two positions share a key.
+   */
+  std::atomic<uint64_t> collisions;
+};
+
+inline thread_local Counters counters;
+
+inline void count(std::atomic<uint64_t>& counter) {
+  counter.store(counter.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+}
+
+/**
+ * A summary of the table's health: the counters of every registered thread
+ * since the start of the current search, and the distribution of the depths
+ * and ages of the entries in the table.
+ */
+struct Stats {
+  uint64_t probes = 0;
+  uint64_t hits = 0;
+  uint64_t stores = 0;
+  uint64_t overwrites = 0;
+  uint64_t collisions = 0;
+  uint64_t entries = 0;
+  std::array<uint64_t, 256> depths{};
+  std::array<uint64_t, kGenerationCount> ages{};
+};
+
+/**
+ * Returns the cluster that the given key maps to. Rather than key % kTableSize,
+ * which costs a division on every probe, this scales the key into the table as
+ * a fixed-point fraction: the high half of key * kTableSize is uniform over
+ * [0, kTableSize) for uniformly distributed keys, for any table size.
+ */
+inline Cluster& cluster(uint64_t key) {
+  return kTable[multiply_high64(key, kTableSize)];
+}
+
+/**
+ * Starts loading the cluster for the given key into the cache, ahead of a
+ * probe. Large tables mostly miss the cache, so a probe that follows a timely
+ * prefetch avoids waiting on memory.
+ */
+inline void prefetch(uint64_t key) { prefetch_cache_line(&cluster(key)); }
 
-void initialize(uint64_t hashSize);
+/**
+ * Allocates and clears a table of the given size in megabytes, using the given
+ * number of threads to clear it, and replaces the current table with it.
+ *
+ * @throws std::bad_alloc if the table can't be allocated, in which case the
+ * current table is left in place.
+ */
+void initialize(uint64_t hashSize, size_t threads = 1);
 void destroy();
+
+/**
+ * Places the table in the named POSIX shared memory segment, so that several
+ * engine processes can search with one table. The segment is created with the
+ * given size in megabytes if it doesn't exist yet; otherwise, the table takes
+ * the size of the existing segment. Entries are lockless and so consistent
+ * across processes, and the table's generation is kept in the segment, so
+ * that every process ages entries alike. The segment outlives the process and
+ * must be removed with shm_unlink (or by deleting it from /dev/shm) once no
+ * longer needed.
+ *
+ * @throws std::runtime_error if the segment can't be created or attached to.
+ */
+void initialize_shared(const std::string& name, uint64_t hashSize);
+
+/**
+ * Returns true if the table is shared with other processes.
+ */
+bool shared();
+
+/**
+ * Empties the table, dividing the work between the given number of threads.
+ * Must not be called while a search is running.
+ */
+void clear(size_t threads = 1);
+
+/**
+ * Writes the table to the given file, or loads a table written by save from
+ * it, replacing the current table. The loaded table has the size of the saved
+ * one. Neither may be called while a search is running.
+ *
+ * @throws std::runtime_error if the file can't be written or read, or doesn't
+ * hold a table saved by this version of Altair. Where the file can't be
+ * mapped, load may also throw std::bad_alloc. Either way, the current table
+ * is left in place.
+ */
+void save(const std::string& path);
+void load(const std::string& path);
+
+/**
+ * Adds the calling thread's counters to those reported by stats, or removes
+ * them, keeping their totals. Search threads register for their lifetime.
+ */
+void register_thread();
+void unregister_thread();
+
+/**
+ * Gathers the table's statistics. Scans the whole table, so this is meant for
+ * debugging rather than for use during a search.
+ */
+Stats stats();
+
+/**
+ * Estimates how full the table is, in permille, from the proportion of the
+ * entries in its first thousand clusters that were stored by this search.
+ */
+unsigned hashfull();
+
+/**
+ * Notes that a hit's move was not legal in the position it was probed for.
+ */
+inline void record_collision() { count(counters.collisions); }
+
+/**
+ * Advances the table's generation; called at the start of every search. When
+ * choosing an entry to replace, entries from older searches are preferred.
+ */
+void new_search();
+
 void record_pv(const Position& pos, Move best, unsigned depth, Value value);
 void record_cut(const Position& pos, Move best, unsigned depth, Value value);
 void record_all(const Position& pos, unsigned depth, Value value);
@@ -89,9 +277,19 @@ void record_all(const Position& pos, unsigned depth, Value value);
 template <typename F>
 auto query(const Position& pos, F func) -> decltype(func(TableEntry{})) {
   uint64_t key = pos.hash();
-  RawTableEntry& entry =
-      kTable.load(std::memory_order_relaxed)[key % kTableSize];
-  return entry.with_lock([&](TableEntry& entry) { return func(entry); });
+  TableEntry entry{};
+  entry.zobrist_key = ~key;
+  count(counters.probes);
+  for (const PackedEntry& packed : cluster(key).entries) {
+    TableEntry candidate = packed.load();
+    if (candidate.depth != 0 && candidate.zobrist_key == key) {
+      entry = candidate;
+      count(counters.hits);
+      break;
+    }
+  }
+
+  return func(entry);
 }
 
 }  // namespace ttable
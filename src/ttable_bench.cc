@@ -0,0 +1,92 @@
+/*
+ *  This file is a part of Altair, a chess engine.
+ *  Copyright (C) 2017-2023 Sean Gillespie <sean@swgillespie.me>.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/**
+ * Microbenchmark for transposition table probes, comparing the latency of
+ * mapping keys to clusters with a modulo against the multiply-high mapping
+ * that the table uses.
+ *
+ * Usage: ttable_bench [hash size in MB]
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "compiler.h"
+#include "ttable.h"
+
+namespace {
+
+using altair::Cluster;
+using altair::ttable::kTable;
+using altair::ttable::kTableSize;
+
+constexpr size_t kProbeCount = 1 << 24;
+constexpr uint64_t kDefaultHashSize = 256;
+
+/**
+ * Probes the table once for every key and returns the mean time per probe in
+ * nanoseconds. Each key is made to depend on the result of the previous probe,
+ * so that probes can't overlap and the time measured is their latency.
+ */
+template <typename Index>
+double measure(const std::vector<uint64_t>& keys, Index index) {
+  auto start = std::chrono::steady_clock::now();
+  uint64_t carry = 0;
+  for (uint64_t key : keys) {
+    const Cluster& cluster = kTable[index(key ^ carry)];
+    carry = cluster.entries[0].load().depth;
+  }
+
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::nano> elapsed = end - start;
+  volatile uint64_t sink = carry;
+  (void)sink;
+  return elapsed.count() / keys.size();
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  uint64_t hash_size = argc > 1 ? std::stoull(argv[1]) : kDefaultHashSize;
+  altair::ttable::initialize(hash_size);
+
+  std::mt19937_64 rng(0xA17A1);
+  std::vector<uint64_t> keys(kProbeCount);
+  for (uint64_t& key : keys) {
+    key = rng();
+  }
+
+  // Warm up the table and the keys, then alternate the two mappings a few
+  // times so that neither benefits from running first.
+  measure(keys, [](uint64_t key) { return key % kTableSize; });
+  for (int round = 0; round < 3; round++) {
+    double modulo = measure(keys, [](uint64_t key) { return key % kTableSize; });
+    double multiply = measure(
+        keys, [](uint64_t key) { return multiply_high64(key, kTableSize); });
+    std::cout << "round " << round << ": modulo " << modulo
+              << " ns/probe, multiply-high " << multiply << " ns/probe"
+              << std::endl;
+  }
+
+  altair::ttable::destroy();
+}
@@ -18,10 +18,29 @@
 
 #include "ttable.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
 #include "gtest/gtest.h"
+#include "movegen.h"
 #include "position.h"
 #include "value.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using altair::Cluster;
 using altair::Move;
 using altair::Position;
 using altair::Square;
@@ -33,6 +52,62 @@ class TTableTest : public ::testing::Test {
   void TearDown() override { altair::ttable::destroy(); }
 };
 
+namespace {
+
+bool in_table(const Position& pos) {
+  return altair::ttable::query(pos, [&pos](const TableEntry& entry) {
+    return entry.zobrist_key == pos.hash();
+  });
+}
+
+/**
+ * Finds the given number of distinct positions, four plies from the start,
+ * that all map to the same cluster.
+ */
+std::vector<Position> positions_in_one_cluster(size_t count) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  // Positions are kept as FENs, but told apart by key: FENs that differ only
+  // in their move counters are the same position.
+  using Keyed = std::pair<uint64_t, std::string>;
+  std::unordered_map<const Cluster*, std::vector<Keyed>> clusters;
+  const std::vector<Keyed>* found = nullptr;
+  std::function<void(unsigned)> walk = [&](unsigned depth) {
+    if (depth == 0) {
+      auto& same = clusters[&altair::ttable::cluster(pos.hash())];
+      if (std::none_of(same.begin(), same.end(), [&](const Keyed& other) {
+            return other.first == pos.hash();
+          })) {
+        same.emplace_back(pos.hash(), pos.fen());
+        if (same.size() == count) {
+          found = &same;
+        }
+      }
+      return;
+    }
+
+    altair::MoveList moves;
+    altair::movegen::generate_legal(pos, moves);
+    for (Move move : moves) {
+      pos.make_move(move);
+      walk(depth - 1);
+      pos.unmake_move(move);
+      if (found != nullptr) {
+        return;
+      }
+    }
+  };
+  walk(4);
+
+  std::vector<Position> positions(found != nullptr ? count : 0);
+  for (size_t i = 0; i < positions.size(); i++) {
+    positions[i].set((*found)[i].second);
+  }
+  return positions;
+}
+
+}  // namespace
+
 TEST_F(TTableTest, query_miss) {
   Position pos;
   pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
@@ -58,3 +133,216 @@ TEST_F(TTableTest, query_pv) {
       });
   EXPECT_TRUE(found);
 }
+
+TEST_F(TTableTest, cluster_holds_several_positions) {
+  // Find two positions that map to the same cluster among the positions two
+  // plies from the start.
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  std::unordered_map<const altair::Cluster*, Position> by_cluster;
+  std::optional<std::pair<Position, Position>> same_cluster;
+  altair::MoveList moves;
+  altair::movegen::generate_legal(pos, moves);
+  for (Move move : moves) {
+    pos.make_move(move);
+    altair::MoveList replies;
+    altair::movegen::generate_legal(pos, replies);
+    for (Move reply : replies) {
+      pos.make_move(reply);
+      const altair::Cluster* cluster = &altair::ttable::cluster(pos.hash());
+      auto [it, inserted] = by_cluster.emplace(cluster, pos);
+      if (!inserted && !same_cluster) {
+        same_cluster.emplace(it->second, pos);
+      }
+      pos.unmake_move(reply);
+    }
+    pos.unmake_move(move);
+  }
+
+  ASSERT_TRUE(same_cluster);
+  auto& [first, second] = *same_cluster;
+  altair::ttable::record_pv(first, Move::quiet(Square::A2, Square::A4), 3,
+                            Value(10));
+  altair::ttable::record_pv(second, Move::quiet(Square::B2, Square::B4), 5,
+                            Value(20));
+  for (const Position* p : {&first, &second}) {
+    bool found = altair::ttable::query(
+        *p, [p](const TableEntry& entry) -> bool {
+          return entry.zobrist_key == p->hash();
+        });
+    EXPECT_TRUE(found);
+  }
+}
+
+TEST_F(TTableTest, new_search_ages_entries) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  altair::ttable::new_search();
+  altair::ttable::record_pv(pos, Move::quiet(Square::A2, Square::A4), 10,
+                            Value(100));
+  uint8_t stored = altair::ttable::query(
+      pos, [](const TableEntry& entry) { return entry.generation; });
+  altair::ttable::new_search();
+  altair::ttable::record_cut(pos, Move::quiet(Square::B2, Square::B4), 4,
+                             Value(50));
+  uint8_t restored = altair::ttable::query(
+      pos, [](const TableEntry& entry) { return entry.generation; });
+  EXPECT_EQ((stored + 1) % altair::kGenerationCount, restored);
+}
+
+TEST_F(TTableTest, stale_entry_is_replaced_before_fresh_ones) {
+  std::vector<Position> positions =
+      positions_in_one_cluster(Cluster::kEntryCount + 1);
+  ASSERT_EQ(Cluster::kEntryCount + 1, positions.size());
+
+  // A deep entry from a few searches ago is worth less than shallow entries
+  // from this search.
+  Move move = Move::quiet(Square::A2, Square::A4);
+  altair::ttable::record_pv(positions[0], move, 20, Value(0));
+  for (int i = 0; i < 3; i++) {
+    altair::ttable::new_search();
+  }
+  for (size_t i = 1; i < Cluster::kEntryCount; i++) {
+    altair::ttable::record_pv(positions[i], move, 2, Value(0));
+  }
+
+  altair::ttable::record_pv(positions.back(), move, 1, Value(0));
+  EXPECT_FALSE(in_table(positions[0]));
+  for (size_t i = 1; i < positions.size(); i++) {
+    EXPECT_TRUE(in_table(positions[i]));
+  }
+}
+
+TEST_F(TTableTest, deep_entry_survives_shallower_store) {
+  std::vector<Position> positions =
+      positions_in_one_cluster(Cluster::kEntryCount + 1);
+  ASSERT_EQ(Cluster::kEntryCount + 1, positions.size());
+
+  // Within one search, the shallowest entry is the one replaced.
+  Move move = Move::quiet(Square::A2, Square::A4);
+  altair::ttable::new_search();
+  altair::ttable::record_pv(positions[0], move, 10, Value(0));
+  altair::ttable::record_pv(positions[1], move, 3, Value(0));
+  for (size_t i = 2; i < Cluster::kEntryCount; i++) {
+    altair::ttable::record_pv(positions[i], move, 5, Value(0));
+  }
+
+  altair::ttable::record_pv(positions.back(), move, 2, Value(0));
+  EXPECT_TRUE(in_table(positions[0]));
+  EXPECT_FALSE(in_table(positions[1]));
+  EXPECT_TRUE(in_table(positions.back()));
+}
+
+TEST_F(TTableTest, clear_empties_table) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  altair::ttable::record_pv(pos, Move::quiet(Square::A2, Square::A4), 10,
+                            Value(100));
+  altair::ttable::clear(3);
+  auto found = altair::ttable::query(
+      pos, [&pos = std::as_const(pos)](const TableEntry& entry) {
+        return entry.zobrist_key == pos.hash();
+      });
+  EXPECT_FALSE(found);
+}
+
+TEST_F(TTableTest, save_and_load_round_trip) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  altair::ttable::record_pv(pos, Move::quiet(Square::A2, Square::A4), 10,
+                            Value(100));
+  std::string path = ::testing::TempDir() + "ttable_test.tt";
+  altair::ttable::save(path);
+  altair::ttable::clear();
+  altair::ttable::load(path);
+  std::remove(path.c_str());
+
+  auto found = altair::ttable::query(
+      pos, [&pos = std::as_const(pos)](const TableEntry& entry) -> bool {
+        EXPECT_EQ(entry.move, Move::quiet(Square::A2, Square::A4));
+        EXPECT_EQ(entry.value, Value(100));
+        return entry.zobrist_key == pos.hash();
+      });
+  EXPECT_TRUE(found);
+}
+
+TEST_F(TTableTest, load_rejects_other_files) {
+  std::string path = ::testing::TempDir() + "ttable_test.txt";
+  std::ofstream(path) << "not a table";
+  EXPECT_THROW(altair::ttable::load(path), std::runtime_error);
+  std::remove(path.c_str());
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_F(TTableTest, shared_table_is_reattached) {
+  std::string name = "/altair-ttable-test-" + std::to_string(getpid());
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  altair::ttable::initialize_shared(name, 1);
+  EXPECT_TRUE(altair::ttable::shared());
+  altair::ttable::record_pv(pos, Move::quiet(Square::A2, Square::A4), 10,
+                            Value(100));
+
+  // Attaching again, as another process would, finds the entry.
+  altair::ttable::destroy();
+  altair::ttable::initialize_shared(name, 1);
+  shm_unlink(name.c_str());
+  auto found = altair::ttable::query(
+      pos, [&pos = std::as_const(pos)](const TableEntry& entry) {
+        return entry.zobrist_key == pos.hash();
+      });
+  EXPECT_TRUE(found);
+}
+
+TEST_F(TTableTest, shared_table_shares_generation) {
+  std::string name = "/altair-ttable-test-" + std::to_string(getpid());
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  altair::ttable::initialize_shared(name, 1);
+
+  // Another process starts a search and stores an entry in it...
+  pid_t child = fork();
+  ASSERT_NE(-1, child);
+  if (child == 0) {
+    altair::ttable::initialize_shared(name, 1);
+    altair::ttable::new_search();
+    altair::ttable::new_search();
+    altair::ttable::record_pv(pos, Move::quiet(Square::A2, Square::A4), 10,
+                              Value(100));
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  shm_unlink(name.c_str());
+  ASSERT_TRUE(WIFEXITED(status));
+
+  // ...which this process sees as stored by the current search.
+  altair::ttable::Stats stats = altair::ttable::stats();
+  EXPECT_EQ(1, stats.entries);
+  EXPECT_EQ(1, stats.ages[0]);
+}
+#endif
+
+TEST_F(TTableTest, stats_count_probes_and_entries) {
+  Position pos;
+  pos.set("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+  auto matches = [&pos = std::as_const(pos)](const TableEntry& entry) {
+    return entry.zobrist_key == pos.hash();
+  };
+
+  altair::ttable::register_thread();
+  altair::ttable::new_search();
+  altair::ttable::query(pos, matches);
+  altair::ttable::record_pv(pos, Move::quiet(Square::A2, Square::A4), 10,
+                            Value(100));
+  altair::ttable::query(pos, matches);
+  altair::ttable::unregister_thread();
+
+  altair::ttable::Stats stats = altair::ttable::stats();
+  EXPECT_EQ(2, stats.probes);
+  EXPECT_EQ(1, stats.hits);
+  EXPECT_EQ(1, stats.stores);
+  EXPECT_EQ(1, stats.entries);
+  EXPECT_EQ(1, stats.depths[10]);
+  EXPECT_EQ(1, stats.ages[0]);
+}
@@ -18,18 +18,76 @@
 
 #include "uci.h"
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
 #include <cstdlib>
+#include <exception>
 #include <iostream>
+#include <new>
+#include <optional>
 #include <string>
 
 #include "eval.h"
 #include "log.h"
+#include "movegen.h"
 #include "search.h"
 #include "thread.h"
+#include "ttable.h"
 
 namespace altair::uci {
 
+/**
+ * Size of the transposition table, in megabytes. Larger tables than the
+ * maximum are beyond the memory of the machines the engine runs on.
+ */
+constexpr uint64_t kDefaultHashSize = 16;
+constexpr uint64_t kMaxHashSize = 1 << 15;
+
+/**
+ * Upper bound on the number of search threads.
+ */
+constexpr unsigned kMaxThreads = 512;
+
 static Position pos;
+static uint64_t hash_size = kDefaultHashSize;
+
+/**
+ * The name of the shared memory segment holding the table, or empty if the
+ * table is private to this process.
+ */
+static std::string shared_hash;
+
+/**
+ * Parses an option value that must be a number, returning nothing if the
+ * value isn't one or has anything after the number.
+ */
+template <typename T>
+std::optional<T> parse_number(const std::string& value) {
+  T number{};
+  const char* end = value.data() + value.size();
+  auto [ptr, error] = std::from_chars(value.data(), end, number);
+  if (error != std::errc() || ptr != end) {
+    return {};
+  }
+  return number;
+}
+
+/**
+ * Finds the legal move in the current position corresponding to the given UCI
+ * move string, returning the null move if there isn't one.
+ */
+Move parse_move(const std::string& str) {
+  MoveList moves;
+  movegen::generate_legal(pos, moves);
+  for (Move move : moves) {
+    if (move.as_uci() == str) {
+      return move;
+    }
+  }
+
+  return Move::null();
+}
 
 void position(const std::string& buf) {
   std::istringstream is(buf);
@@ -50,7 +108,17 @@ void position(const std::string& buf) {
   pos = Position();
   pos.set(fen);
 
-  // TODO(swgillespie) moves
+  while (is >> token) {
+    Move move = parse_move(token);
+    if (move.is_null()) {
+      break;
+    }
+    pos.make_move(move);
+
+    // Nothing unmakes the game's moves, and keeping every state a long game
+    // leaves behind would leave no room for the search.
+    pos.discard_history();
+  }
 }
 
 void go(const std::string& buf) {
@@ -59,12 +127,190 @@ void go(const std::string& buf) {
 
   SearchLimits limits;
   while (is >> token) {
-    if (token == "perft") is >> limits.perft;
+    int64_t ms;
+    if (token == "perft") {
+      is >> limits.perft;
+    } else if (token == "depth") {
+      is >> limits.depth;
+    } else if (token == "nodes") {
+      is >> limits.nodes;
+    } else if (token == "movestogo") {
+      is >> limits.movestogo;
+    } else if (token == "infinite") {
+      limits.infinite = true;
+    } else if (token == "movetime" && is >> ms) {
+      limits.movetime = std::chrono::milliseconds(ms);
+    } else if (token == "wtime" && is >> ms) {
+      limits.time[kWhite] = std::chrono::milliseconds(ms);
+    } else if (token == "btime" && is >> ms) {
+      limits.time[kBlack] = std::chrono::milliseconds(ms);
+    } else if (token == "winc" && is >> ms) {
+      limits.increment[kWhite] = std::chrono::milliseconds(ms);
+    } else if (token == "binc" && is >> ms) {
+      limits.increment[kBlack] = std::chrono::milliseconds(ms);
+    }
   }
 
   Threads::go(pos, limits);
 }
 
+void clear_hash() {
+  Threads::wait_until_idle();
+  ttable::clear(Threads::all().size());
+}
+
+/**
+ * Replaces the table with one of the current size, in the shared memory
+ * segment if one is set. Falls back to a private table if the segment can't
+ * be used. Returns false, leaving the current table in place, if a private
+ * table of that size can't be allocated.
+ */
+bool reset_hash() {
+  // The table can't be replaced while any thread might be probing it.
+  Threads::wait_until_idle();
+  if (!shared_hash.empty()) {
+    try {
+      ttable::initialize_shared(shared_hash, hash_size);
+      return true;
+    } catch (const std::exception& e) {
+      UCI() << "info string " << e.what();
+      shared_hash.clear();
+    }
+  }
+
+  try {
+    ttable::initialize(hash_size, Threads::all().size());
+    return true;
+  } catch (const std::bad_alloc&) {
+    UCI() << "info string failed to allocate " << hash_size
+          << " MB for Hash, keeping the current table";
+    return false;
+  }
+}
+
+void setoption(const std::string& buf) {
+  std::istringstream is(buf);
+  std::string token;
+  is >> token >> token;  // "setoption name"
+
+  // Option names can contain spaces; everything up to "value" is the name.
+  std::string name;
+  while (is >> token && token != "value") {
+    name += name.empty() ? token : " " + token;
+  }
+
+  std::string value;
+  std::getline(is >> std::ws, value);
+  if (name == "Threads") {
+    std::optional<unsigned> threads = parse_number<unsigned>(value);
+    if (!threads) {
+      UCI() << "info string invalid value for Threads: " << value;
+      return;
+    }
+    Threads::set_count(std::clamp(*threads, 1u, kMaxThreads));
+  } else if (name == "ParallelSearch") {
+    Threads::set_mode(value == "YBWC" ? ParallelMode::kYBWC
+                                      : ParallelMode::kLazySMP);
+  } else if (name == "Hash") {
+    std::optional<uint64_t> size = parse_number<uint64_t>(value);
+    if (!size) {
+      UCI() << "info string invalid value for Hash: " << value;
+      return;
+    }
+    uint64_t previous = hash_size;
+    hash_size = std::clamp<uint64_t>(*size, 1, kMaxHashSize);
+    if (ttable::shared()) {
+      // The segment was sized by whichever process created it.
+      UCI() << "info string Hash does not resize shared table " << shared_hash
+            << "; it applies once SharedHash is cleared";
+      return;
+    }
+    if (!reset_hash()) {
+      hash_size = previous;
+    }
+  } else if (name == "SharedHash") {
+    shared_hash = value == "<empty>" ? "" : value;
+    reset_hash();
+  } else if (name == "Clear Hash") {
+    clear_hash();
+  }
+}
+
+/**
+ * Prints the table's statistics, as gathered by ttable::stats.
+ */
+void tt_stats() {
+  Threads::wait_until_idle();
+  ttable::Stats stats = ttable::stats();
+  auto percent = [](uint64_t part, uint64_t whole) {
+    return whole != 0 ? part * 100 / whole : 0;
+  };
+
+  uint64_t capacity = ttable::kTableSize * Cluster::kEntryCount;
+  UCI() << "info string entries " << stats.entries << " of " << capacity
+        << " (" << percent(stats.entries, capacity) << "%) hashfull "
+        << ttable::hashfull();
+  UCI() << "info string probes " << stats.probes << " hits " << stats.hits
+        << " (" << percent(stats.hits, stats.probes) << "%) collisions "
+        << stats.collisions;
+  UCI() << "info string stores " << stats.stores << " overwrites "
+        << stats.overwrites << " ("
+        << percent(stats.overwrites, stats.stores) << "%)";
+
+  std::ostringstream depths;
+  for (size_t depth = 0; depth < stats.depths.size(); depth++) {
+    if (stats.depths[depth] != 0) {
+      depths << ' ' << depth << ':' << stats.depths[depth];
+    }
+  }
+  UCI() << "info string depths" << depths.str();
+
+  std::ostringstream ages;
+  for (size_t age = 0; age < stats.ages.size(); age++) {
+    if (stats.ages[age] != 0) {
+      ages << ' ' << age << ':' << stats.ages[age];
+    }
+  }
+  UCI() << "info string ages" << ages.str();
+}
+
+/**
+ * Non-standard commands for the transposition table: "tt save <file>" writes
+ * the table to disk, "tt load <file>" replaces it with a saved one, and
+ * "tt stats" prints statistics about the table and the last search's use of
+ * it.
+ */
+void tt(const std::string& buf) {
+  std::istringstream is(buf);
+  std::string token;
+  is >> token >> token;  // "tt <subcommand>"
+  if (token == "stats") {
+    tt_stats();
+    return;
+  }
+
+  // Paths can contain spaces; everything after the subcommand is the path.
+  std::string path;
+  std::getline(is >> std::ws, path);
+  if (path.empty()) {
+    UCI() << "info string usage: tt save|load <file>, tt stats";
+    return;
+  }
+
+  Threads::wait_until_idle();
+  try {
+    if (token == "save") {
+      ttable::save(path);
+    } else if (token == "load") {
+      ttable::load(path);
+    } else {
+      UCI() << "info string unknown tt command " << token;
+    }
+  } catch (const std::exception& e) {
+    UCI() << "info string " << e.what();
+  }
+}
+
 void eval() {
   Value result = eval::evaluate(pos);
   UCI() << result.as_uci();
@@ -93,25 +339,55 @@ void run_one(const std::string& buf) {
   } else if (command == "uci") {
     UCI() << "id name altair 0.1.0";
     UCI() << "id author Sean Gillespie <sean@swgillespie.me>";
+    UCI() << "option name Threads type spin default 1 min 1 max "
+          << kMaxThreads;
+    UCI() << "option name ParallelSearch type combo default LazySMP var "
+             "LazySMP var YBWC";
+    UCI() << "option name Hash type spin default " << kDefaultHashSize
+          << " min 1 max " << kMaxHashSize;
+    UCI() << "option name Clear Hash type button";
+    UCI() << "option name SharedHash type string default <empty>";
     UCI() << "uciok";
   } else if (command == "isready") {
-    Threads::wait_until_idle();
+    // The GUI may ask this at any time, including during an infinite search
+    // that only it can stop, so don't wait on the search threads here.
     UCI() << "readyok";
   } else if (command == "position") {
     position(buf);
   } else if (command == "go") {
     go(buf);
+  } else if (command == "setoption") {
+    setoption(buf);
+  } else if (command == "ucinewgame") {
+    Threads::clear();
+    // A shared table holds work that other processes are still using.
+    if (!ttable::shared()) {
+      clear_hash();
+    }
+  } else if (command == "stop") {
+    Threads::stop();
   } else if (command == "quit") {
     std::exit(0);
   } else if (command == "bench") {
     bench();
   } else if (command == "eval") {
     eval();
+  } else if (command == "tt") {
+    tt(buf);
   }
 }
 
 void run(int argc, char* argv[]) {
   Threads::initialize();
+  try {
+    ttable::initialize(hash_size, Threads::all().size());
+  } catch (const std::bad_alloc&) {
+    // Searching needs some table, so settle for the smallest one.
+    UCI() << "info string failed to allocate " << hash_size
+          << " MB for Hash, using 1 MB";
+    hash_size = 1;
+    ttable::initialize(hash_size, Threads::all().size());
+  }
 
   if (argc == 2 && argv[1] == std::string("bench")) {
     run_one("bench");
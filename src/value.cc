@@ -27,7 +27,8 @@ namespace {
 
 const int16_t kValueMated = std::numeric_limits<int16_t>::min() / 2 + 1;
 const int16_t kValueMate = std::numeric_limits<int16_t>::max() / 2;
-const int16_t kMateDistanceMax = 50;
+const int16_t kMateDistanceMax = 256;
+const int16_t kValueInfinity = std::numeric_limits<int16_t>::max() - 1;
 
 }  // namespace
 
@@ -41,6 +42,36 @@ Value Value::mated_in(unsigned ply) {
   return Value(kValueMated - kMateDistanceMax + ply);
 }
 
+Value Value::infinity() { return Value(kValueInfinity); }
+
+bool Value::is_mate() const {
+  return centipawns_ > kValueMate || centipawns_ < kValueMated;
+}
+
+Value Value::to_table(unsigned ply) const {
+  if (centipawns_ > kValueMate) {
+    return Value(centipawns_ + ply);
+  }
+  if (centipawns_ < kValueMated) {
+    return Value(centipawns_ - ply);
+  }
+  return *this;
+}
+
+Value Value::from_table(unsigned ply) const {
+  if (centipawns_ > kValueMate) {
+    return Value(centipawns_ - ply);
+  }
+  if (centipawns_ < kValueMated) {
+    return Value(centipawns_ + ply);
+  }
+  return *this;
+}
+
+Value Value::next() const { return Value(centipawns_ + 1); }
+
+Value Value::prev() const { return Value(centipawns_ - 1); }
+
 Value Value::operator+(const Value& other) const {
   CHECK(centipawns_ > kValueMated && centipawns_ < kValueMate);
   int16_t next = centipawns_ + other.centipawns_;
@@ -68,15 +99,36 @@ bool Value::operator==(const Value& other) const {
   return centipawns_ == other.centipawns_;
 }
 
+bool Value::operator!=(const Value& other) const {
+  return centipawns_ != other.centipawns_;
+}
+
+bool Value::operator<(const Value& other) const {
+  return centipawns_ < other.centipawns_;
+}
+
+bool Value::operator<=(const Value& other) const {
+  return centipawns_ <= other.centipawns_;
+}
+
+bool Value::operator>(const Value& other) const {
+  return centipawns_ > other.centipawns_;
+}
+
+bool Value::operator>=(const Value& other) const {
+  return centipawns_ >= other.centipawns_;
+}
+
 std::string Value::as_uci() const {
   std::ostringstream ss;
 
+  // Mate scores count plies, while UCI reports mates in full moves.
   if (centipawns_ > kValueMate) {
-    int16_t moves = kValueMate + kMateDistanceMax - centipawns_;
-    ss << "mate " << moves;
+    int16_t plies = kValueMate + kMateDistanceMax - centipawns_;
+    ss << "mate " << (plies + 1) / 2;
   } else if (centipawns_ < kValueMated) {
-    int16_t moves = centipawns_ - kValueMated + kMateDistanceMax;
-    ss << "mate -" << moves;
+    int16_t plies = centipawns_ - kValueMated + kMateDistanceMax;
+    ss << "mate -" << plies / 2;
   } else {
     ss << "cp " << centipawns_;
   }
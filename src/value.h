@@ -34,12 +34,43 @@ class Value {
   static Value mated_in(unsigned ply);
   static Value mate_in(unsigned ply);
 
+  /**
+   * A value greater than any score that a search can produce, used to
+   * initialize search windows.
+   */
+  static Value infinity();
+
+  /**
+   * Returns true if this value represents a forced mate for either side.
+   */
+  bool is_mate() const;
+
+  /**
+   * Mate scores are relative to the root of a search, while the transposition
+   * table stores them relative to the node they were found at. These adjust a
+   * score produced at the given ply to and from the table's representation.
+   */
+  Value to_table(unsigned ply) const;
+  Value from_table(unsigned ply) const;
+
+  /**
+   * The values immediately above and below this one. Unlike operator+, these
+   * are valid for mate scores and are used to construct null windows.
+   */
+  Value next() const;
+  Value prev() const;
+
   Value operator+(const Value& other) const;
   Value operator-(const Value& other) const;
   Value operator-() const;
   Value& operator+=(const Value& other);
   Value& operator-=(const Value& other);
   bool operator==(const Value& other) const;
+  bool operator!=(const Value& other) const;
+  bool operator<(const Value& other) const;
+  bool operator<=(const Value& other) const;
+  bool operator>(const Value& other) const;
+  bool operator>=(const Value& other) const;
 
   std::string as_uci() const;
 
@@ -10,7 +10,7 @@ const uint64_t kZobristHashSeed = 0xf68e34a4e8ccf09a;
 const uint64_t kZobristEntryCount = 781;
 const uint64_t kZobristSideToMoveEntry = 768;
 const uint64_t kZobristCastlingRightsEntry = 769;
-const uint64_t kZobristEnPassantEntry = 770;
+const uint64_t kZobristEnPassantEntry = 773;
 
 class XorShift64 {
  public:
@@ -76,14 +76,16 @@ void modify_queenside_castle(uint64_t *hash, Color color) {
 }
 
 void modify_en_passant(uint64_t *hash, Square oldSquare, Square newSquare) {
+  // The rank of an en passant square follows from the side to move, so only
+  // its file is hashed.
   if (oldSquare != kNoSquare) {
     *hash ^= kMagicHashes[kZobristEnPassantEntry +
-                          static_cast<uintptr_t>(oldSquare)];
+                          static_cast<uintptr_t>(file_of(oldSquare))];
   }
 
   if (newSquare != kNoSquare) {
     *hash ^= kMagicHashes[kZobristEnPassantEntry +
-                          static_cast<uintptr_t>(newSquare)];
+                          static_cast<uintptr_t>(file_of(newSquare))];
   }
 }
 